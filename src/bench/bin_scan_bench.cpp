@@ -0,0 +1,124 @@
+// Compares common::bin_scan kernels against each other and memmem on
+// delimiter-like patterns. The scalar kernel is the byte-by-byte memcmp
+// scan bin_scan had before the SIMD kernels.
+
+#include "common/base/bin_scan.h"
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+using namespace std;
+
+typedef void* (*scan_fn)(const void*, size_t, const void*, size_t);
+
+#if defined(__GLIBC__)
+static void* scan_memmem(const void* mem, size_t mem_len,
+                         const void* pat, size_t pat_len)
+{
+  return memmem(mem, mem_len, pat, pat_len);
+}
+#endif
+
+struct kernel {
+  const char* name;
+  scan_fn     fn;
+};
+
+// Header-like text without |pat|, then |pat| at the very end.
+static vector<char> make_input(size_t len, const string& pat) {
+  static const char kAlphabet[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789:-/ \r\n";
+  mt19937 rng(12345);
+  uniform_int_distribution<size_t> dist(0, sizeof(kAlphabet) - 2);
+
+  vector<char> buf(len);
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = kAlphabet[dist(rng)];
+    // Never let the pattern appear early
+    if (i + 1 >= pat.length() &&
+        !memcmp(&buf[i + 1 - pat.length()], pat.data(), pat.length()))
+    {
+      buf[i] = 'x';
+    }
+  }
+  // No overlapping match right before the final one either.
+  memset(&buf[len - 2 * pat.length()], 'x', pat.length());
+  memcpy(&buf[len - pat.length()], pat.data(), pat.length());
+  return buf;
+}
+
+static double bench_ns(scan_fn fn, const vector<char>& mem,
+  const string& pat)
+{
+  const size_t kTargetBytes = 256 * 1024 * 1024;
+  const size_t iters = kTargetBytes / mem.size() + 1;
+
+  volatile uintptr_t sink = 0;
+  auto t0 = chrono::steady_clock::now();
+  for (size_t i = 0; i < iters; i++) {
+    sink += reinterpret_cast<uintptr_t>(
+      fn(mem.data(), mem.size(), pat.data(), pat.length()));
+  }
+  auto t1 = chrono::steady_clock::now();
+  (void)sink;
+
+  return chrono::duration<double, nano>(t1 - t0).count() / iters;
+}
+
+int main() {
+  vector<kernel> kernels;
+  kernels.push_back(kernel{"scalar", &common::detail::bin_scan_scalar});
+  if (common::detail::bin_scan_have_sse2()) {
+    kernels.push_back(kernel{"sse2", &common::detail::bin_scan_sse2});
+  }
+  if (common::detail::bin_scan_have_avx2()) {
+    kernels.push_back(kernel{"avx2", &common::detail::bin_scan_avx2});
+  }
+  kernels.push_back(kernel{"bin_scan", &common::bin_scan});
+#if defined(__GLIBC__)
+  kernels.push_back(kernel{"memmem", &scan_memmem});
+#endif
+
+  const string patterns[] = { "\r\n", "\n\n", "\r\n\r", "\r\n\r\n" };
+  const size_t sizes[] = { 1024, 4096, 16384, 65536 };
+
+  cout << left << setw(10) << "pattern" << setw(8) << "bytes";
+  for (size_t k = 0; k < kernels.size(); k++) {
+    cout << right << setw(12) << kernels[k].name;
+  }
+  cout << "   (GB/s)\n";
+
+  for (const string& pat : patterns) {
+    string pat_name;
+    for (char c : pat) {
+      pat_name += c == '\r' ? "\\r" : "\\n";
+    }
+    for (size_t size : sizes) {
+      vector<char> mem(make_input(size, pat));
+
+      cout << left << setw(10) << pat_name << setw(8) << size;
+      for (size_t k = 0; k < kernels.size(); k++) {
+        // Sanity check
+        void* found = kernels[k].fn(mem.data(), mem.size(), pat.data(),
+          pat.length());
+        if (found != &mem[size - pat.length()]) {
+          cout << "\n" << kernels[k].name << ": wrong result\n";
+          return 1;
+        }
+        double ns = bench_ns(kernels[k].fn, mem, pat);
+        cout << right << setw(12) << fixed << setprecision(2) <<
+          size / ns;
+      }
+      cout << "\n";
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,806 @@
+// Connection storm against a running proxyswiss. Prints JSON results.
+//
+// Opens --sessions socks5 or https CONNECT sessions through the proxy,
+// --concurrency handshakes at a time, holds them for --hold seconds, then
+// closes them all at once. While holding, --active percent of the sessions
+// send a --payload byte ping every --think ms (randomized by +-50%) and
+// read it back; the rest stay idle. Socks5 sessions are driven by
+// proxy::client_session, the same code proxyswiss uses for its hops.
+//
+// Every --interval ms a sample is taken: open sessions, handshakes in
+// flight, failures, drops, pings, accept latency (connect() to connection
+// established) and handshake latency (connection established to the proxy
+// reporting success) percentiles over the interval, and RSS and open fds
+// (handles on Windows) of process --pid, this process if 0.
+//
+// Without --target, sessions go to a built-in echo server on 127.0.0.1,
+// so the proxy has to be able to reach this machine's loopback.
+//
+// conn_storm --proxy=ip:port [--type=socks5|https] [--target=ip:port]
+//            [--sessions=N] [--concurrency=N] [--active=PERCENT]
+//            [--think=MS] [--payload=N] [--hold=S] [--drain=S]
+//            [--timeout=MS] [--interval=MS] [--threads=N] [--pid=N]
+//
+// Tens of thousands of sessions need a matching open file limit
+// (ulimit -n) on both sides.
+
+#include "proxy/client_session.h"
+
+#include <boost/asio.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace boost::placeholders;
+using boost::asio::io_context;
+using boost::asio::ip::address_v4;
+using boost::asio::ip::tcp;
+
+typedef chrono::steady_clock steady_clock;
+
+// ---
+
+enum session_type {
+  eSocks5,
+  eHttps
+};
+
+struct options {
+  tcp::endpoint  proxy;
+  tcp::endpoint  target;
+  session_type   type;
+  unsigned       sessions;
+  unsigned       concurrency;
+  unsigned       active;      //< percent
+  unsigned       think_ms;
+  unsigned       payload;
+  unsigned       hold_s;
+  unsigned       drain_s;
+  unsigned       timeout_ms;
+  unsigned       interval_ms;
+  unsigned       threads;
+  unsigned       pid;
+
+  options(): type(eSocks5), sessions(10000), concurrency(256), active(10),
+    think_ms(1000), payload(64), hold_s(30), drain_s(5), timeout_ms(10000),
+    interval_ms(1000), threads(1), pid(0)
+  {
+  }
+};
+
+// ---
+// Built-in echo target
+
+class echo_conn: public boost::enable_shared_from_this<echo_conn> {
+public:
+  explicit echo_conn(tcp::socket sock): sock_(std::move(sock)) {}
+
+  void read() {
+    sock_.async_read_some(boost::asio::buffer(buf_),
+      boost::bind(&echo_conn::handle_read, shared_from_this(), _1, _2));
+  }
+
+private:
+  void handle_read(boost::system::error_code err, size_t num_bytes) {
+    if (!err) {
+      boost::asio::async_write(sock_, boost::asio::buffer(buf_, num_bytes),
+        boost::bind(&echo_conn::handle_write, shared_from_this(), _1, _2));
+    }
+  }
+
+  void handle_write(boost::system::error_code err, size_t) {
+    if (!err) {
+      read();
+    }
+  }
+
+private:
+  tcp::socket  sock_;
+  char         buf_[4096];
+};
+
+class echo_server {
+public:
+  explicit echo_server(io_context& ioc)
+    : acceptor_(ioc, tcp::endpoint(address_v4::loopback(), 0))
+  {
+    acceptor_.listen(boost::asio::socket_base::max_listen_connections);
+    accept();
+  }
+
+  tcp::endpoint endpoint() const { return acceptor_.local_endpoint(); }
+
+private:
+  void accept() {
+    acceptor_.async_accept(
+      [this](boost::system::error_code err, tcp::socket sock) {
+        if (err) {
+          return;
+        }
+        boost::make_shared<echo_conn>(std::move(sock))->read();
+        accept();
+      });
+  }
+
+private:
+  tcp::acceptor  acceptor_;
+};
+
+// ---
+// Process sampling
+
+struct process_sample {
+  size_t rss_kb;
+  size_t fds;
+};
+
+#ifdef _WIN32
+static bool sample_process(unsigned pid, process_sample& s) {
+  HANDLE h = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE,
+    pid ? pid : GetCurrentProcessId());
+  if (!h) {
+    return false;
+  }
+  PROCESS_MEMORY_COUNTERS pmc;
+  DWORD handles = 0;
+  const bool ok = GetProcessMemoryInfo(h, &pmc, sizeof(pmc)) &&
+    GetProcessHandleCount(h, &handles);
+  CloseHandle(h);
+  if (!ok) {
+    return false;
+  }
+  s.rss_kb = pmc.WorkingSetSize / 1024;
+  s.fds = handles;
+  return true;
+}
+#else
+static bool sample_process(unsigned pid, process_sample& s) {
+  const string dir = "/proc/" +
+    (pid ? to_string(pid) : to_string(getpid()));
+
+  ifstream status(dir + "/status");
+  string line;
+  bool found = false;
+  while (getline(status, line)) {
+    if (line.compare(0, 6, "VmRSS:") == 0) {
+      s.rss_kb = strtoul(line.c_str() + 6, nullptr, 10);
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  DIR* d = opendir((dir + "/fd").c_str());
+  if (!d) {
+    return false;
+  }
+  s.fds = 0;
+  while (struct dirent* e = readdir(d)) {
+    if (e->d_name[0] != '.') {
+      s.fds++;
+    }
+  }
+  closedir(d);
+  return true;
+}
+#endif
+
+// ---
+// Load generator
+
+class storm_thread;
+
+class storm_session {
+public:
+  storm_session(storm_thread& owner, bool active);
+
+  void start();
+  void close();
+
+private:
+  void handle_connect(boost::system::error_code);
+  void handle_write_request(boost::system::error_code);
+  void handle_read_response(boost::system::error_code);
+  void handle_write_https_request(boost::system::error_code, size_t);
+  void handle_read_https_response(boost::system::error_code, size_t);
+  void handle_timeout(boost::system::error_code);
+  void handshake_done(bool ok);
+
+  void ping();
+  void handle_ping_write(boost::system::error_code, size_t);
+  void handle_ping_read(boost::system::error_code, size_t);
+  void handle_think(boost::system::error_code);
+  void wait_idle();
+  void handle_idle_read(boost::system::error_code, size_t);
+  void dropped();
+
+private:
+  storm_thread&  owner_;
+  bool           active_;
+  bool           established_;
+  bool           closing_;
+  tcp::socket    sock_;
+  boost::asio::steady_timer  timer_;
+  steady_clock::time_point   start_time_;
+  steady_clock::time_point   connect_time_;
+
+  unique_ptr<proxy::client_session>  cs_;
+  proxy::connect_response            resp_;
+  string                             request_;
+  boost::asio::streambuf             response_;
+  vector<char>                       ping_buf_;
+};
+
+class storm_thread {
+public:
+  storm_thread(const options& opts, const tcp::endpoint& target,
+    size_t num_sessions, size_t concurrency, unsigned seed)
+    :
+    opts_(opts),
+    target_(target),
+    num_sessions_(num_sessions),
+    concurrency_(concurrency),
+    started_(0),
+    in_flight_(0),
+    rng_(seed),
+    established_(0),
+    handshaking_(0),
+    done_(0),
+    failed_(0),
+    dropped_(0),
+    pings_(0)
+  {
+  }
+
+  void start() {
+    boost::asio::post(ioc_, boost::bind(&storm_thread::open_more, this));
+    thread_ = std::thread([this]() { ioc_.run(); });
+  }
+
+  // Closes every session. The thread exits once the handlers are done.
+  void stop() {
+    boost::asio::post(ioc_, [this]() {
+      started_ = num_sessions_;
+      for (size_t i = 0; i < sessions_.size(); i++) {
+        sessions_[i]->close();
+      }
+    });
+  }
+
+  void join() {
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  // Moves the latencies recorded since the last call to the end of
+  // |accept_us| and |handshake_us|.
+  void take_latencies(vector<double>& accept_us, vector<double>& handshake_us)
+  {
+    lock_guard<mutex> lock(latency_mutex_);
+    accept_us.insert(accept_us.end(), accept_us_.begin(), accept_us_.end());
+    handshake_us.insert(handshake_us.end(), handshake_us_.begin(),
+      handshake_us_.end());
+    accept_us_.clear();
+    handshake_us_.clear();
+  }
+
+  bool ramp_done() const { return done_ == num_sessions_; }
+
+private:
+  friend class storm_session;
+
+  void open_more() {
+    while (in_flight_ < concurrency_ && started_ < num_sessions_) {
+      const bool active = rng_() % 100 < opts_.active;
+      sessions_.push_back(
+        unique_ptr<storm_session>(new storm_session(*this, active)));
+      started_++;
+      in_flight_++;
+      handshaking_++;
+      sessions_.back()->start();
+    }
+  }
+
+  void handshake_done(bool ok, double accept_us, double handshake_us) {
+    in_flight_--;
+    handshaking_--;
+    done_++;
+    if (ok) {
+      established_++;
+      lock_guard<mutex> lock(latency_mutex_);
+      accept_us_.push_back(accept_us);
+      handshake_us_.push_back(handshake_us);
+    }
+    else {
+      failed_++;
+    }
+    open_more();
+  }
+
+  unsigned think_ms() {
+    const unsigned t = opts_.think_ms;
+    return t / 2 + (t ? rng_() % (t + 1) : 0);
+  }
+
+private:
+  const options&        opts_;
+  const tcp::endpoint   target_;
+  const size_t          num_sessions_;
+  const size_t          concurrency_;
+  io_context            ioc_;
+  std::thread           thread_;
+  vector<unique_ptr<storm_session>>  sessions_;
+  size_t                started_;
+  size_t                in_flight_;
+  minstd_rand           rng_;
+
+  mutex                 latency_mutex_;
+  vector<double>        accept_us_;
+  vector<double>        handshake_us_;
+
+public:
+  atomic<size_t>  established_;  //< open now
+  atomic<size_t>  handshaking_;
+  atomic<size_t>  done_;         //< handshakes finished either way
+  atomic<size_t>  failed_;
+  atomic<size_t>  dropped_;      //< closed by the other side after success
+  atomic<size_t>  pings_;
+};
+
+storm_session::storm_session(storm_thread& owner, bool active)
+  :
+  owner_(owner),
+  active_(active),
+  established_(false),
+  closing_(false),
+  sock_(owner.ioc_),
+  timer_(owner.ioc_),
+  ping_buf_(std::max(owner.opts_.payload, 1u), 'p')
+{
+}
+
+void storm_session::start() {
+  start_time_ = steady_clock::now();
+  timer_.expires_after(chrono::milliseconds(owner_.opts_.timeout_ms));
+  timer_.async_wait(boost::bind(&storm_session::handle_timeout, this, _1));
+  sock_.async_connect(owner_.opts_.proxy,
+    boost::bind(&storm_session::handle_connect, this, _1));
+}
+
+void storm_session::close() {
+  closing_ = true;
+  if (established_) {
+    established_ = false;
+    owner_.established_--;
+  }
+  boost::system::error_code ec;
+  sock_.close(ec);
+  timer_.cancel();
+}
+
+void storm_session::handle_connect(boost::system::error_code err) {
+  if (err) {
+    handshake_done(false);
+    return;
+  }
+  connect_time_ = steady_clock::now();
+  sock_.set_option(tcp::no_delay(true), err);
+
+  const tcp::endpoint& dst = owner_.target_;
+  if (owner_.opts_.type == eSocks5) {
+    cs_.reset(proxy::create_client_session(sock_,
+      proxy::client_session::eSocks5, proxy::credentials(), "storm"));
+    cs_->write_connect_request(
+      proxy::destination("", dst.address(), dst.port()),
+      boost::bind(&storm_session::handle_write_request, this, _1));
+  }
+  else {
+    const string host = dst.address().to_string() + ":" +
+      to_string(dst.port());
+    request_ = "CONNECT " + host + " HTTP/1.1\r\nHost: " + host + "\r\n\r\n";
+    boost::asio::async_write(sock_, boost::asio::buffer(request_),
+      boost::bind(&storm_session::handle_write_https_request, this, _1, _2));
+  }
+}
+
+void storm_session::handle_write_request(boost::system::error_code err) {
+  if (err) {
+    handshake_done(false);
+    return;
+  }
+  cs_->read_connect_response(resp_,
+    boost::bind(&storm_session::handle_read_response, this, _1));
+}
+
+void storm_session::handle_read_response(boost::system::error_code err) {
+  handshake_done(!err &&
+    resp_.major == proxy::connect_response::eSucceeded);
+}
+
+void storm_session::handle_write_https_request(boost::system::error_code err,
+  size_t)
+{
+  if (err) {
+    handshake_done(false);
+    return;
+  }
+  boost::asio::async_read_until(sock_, response_, "\r\n\r\n",
+    boost::bind(&storm_session::handle_read_https_response, this, _1, _2));
+}
+
+void storm_session::handle_read_https_response(boost::system::error_code err,
+  size_t)
+{
+  // Nothing follows the response until we send something.
+  const char* p = boost::asio::buffer_cast<const char*>(response_.data());
+  handshake_done(!err && response_.size() >= 12 && !memcmp(p + 9, "200", 3));
+}
+
+void storm_session::handle_timeout(boost::system::error_code err) {
+  if (!err && !established_) {
+    // Fails the pending handshake operation.
+    boost::system::error_code ec;
+    sock_.close(ec);
+  }
+}
+
+void storm_session::handshake_done(bool ok) {
+  const auto now = steady_clock::now();
+  timer_.cancel();
+  if (closing_) {
+    ok = false;
+  }
+  if (!ok) {
+    boost::system::error_code ec;
+    sock_.close(ec);
+  }
+  established_ = ok;
+  owner_.handshake_done(ok,
+    chrono::duration<double, micro>(connect_time_ - start_time_).count(),
+    chrono::duration<double, micro>(now - connect_time_).count());
+
+  if (ok) {
+    if (active_) {
+      ping();
+    }
+    else {
+      wait_idle();
+    }
+  }
+}
+
+void storm_session::ping() {
+  boost::asio::async_write(sock_, boost::asio::buffer(ping_buf_),
+    boost::bind(&storm_session::handle_ping_write, this, _1, _2));
+}
+
+void storm_session::handle_ping_write(boost::system::error_code err, size_t) {
+  if (err) {
+    dropped();
+    return;
+  }
+  boost::asio::async_read(sock_, boost::asio::buffer(ping_buf_),
+    boost::bind(&storm_session::handle_ping_read, this, _1, _2));
+}
+
+void storm_session::handle_ping_read(boost::system::error_code err, size_t) {
+  if (err) {
+    dropped();
+    return;
+  }
+  owner_.pings_++;
+  timer_.expires_after(chrono::milliseconds(owner_.think_ms()));
+  timer_.async_wait(boost::bind(&storm_session::handle_think, this, _1));
+}
+
+void storm_session::handle_think(boost::system::error_code err) {
+  if (!err && !closing_) {
+    ping();
+  }
+}
+
+// Nothing is expected, the read only notices the proxy closing.
+void storm_session::wait_idle() {
+  sock_.async_read_some(boost::asio::buffer(&ping_buf_[0], 1),
+    boost::bind(&storm_session::handle_idle_read, this, _1, _2));
+}
+
+void storm_session::handle_idle_read(boost::system::error_code err, size_t) {
+  if (err) {
+    dropped();
+    return;
+  }
+  wait_idle();
+}
+
+void storm_session::dropped() {
+  if (!established_) {
+    return;
+  }
+  established_ = false;
+  owner_.established_--;
+  owner_.dropped_++;
+  boost::system::error_code ec;
+  sock_.close(ec);
+  timer_.cancel();
+}
+
+// ---
+
+static double percentile(vector<double>& v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  sort(v.begin(), v.end());
+  const size_t i = std::min(v.size() - 1, static_cast<size_t>(p * v.size()));
+  return v[i];
+}
+
+static bool parse_endpoint(const string& s, tcp::endpoint& ep) {
+  const size_t colon = s.rfind(':');
+  if (colon == string::npos) {
+    return false;
+  }
+  string host = s.substr(0, colon);
+  if (host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  boost::system::error_code err;
+  const boost::asio::ip::address addr =
+    boost::asio::ip::make_address(host, err);
+  const unsigned long port = strtoul(s.c_str() + colon + 1, nullptr, 10);
+  if (err || port == 0 || port > 65535) {
+    return false;
+  }
+  ep = tcp::endpoint(addr, static_cast<unsigned short>(port));
+  return true;
+}
+
+static bool parse_options(int argc, char* argv[], options& opts) {
+  bool have_proxy = false;
+  for (int i = 1; i < argc; i++) {
+    const string arg(argv[i]);
+    const size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == string::npos) {
+      return false;
+    }
+    const string name = arg.substr(2, eq - 2);
+    const string str = arg.substr(eq + 1);
+    const unsigned value =
+      static_cast<unsigned>(strtoul(str.c_str(), nullptr, 10));
+
+    if (name == "proxy") {
+      if (!parse_endpoint(str, opts.proxy)) return false;
+      have_proxy = true;
+    }
+    else if (name == "target") {
+      if (!parse_endpoint(str, opts.target)) return false;
+    }
+    else if (name == "type") {
+      if (str == "socks5") opts.type = eSocks5;
+      else if (str == "https") opts.type = eHttps;
+      else return false;
+    }
+    else if (name == "sessions") opts.sessions = value;
+    else if (name == "concurrency") opts.concurrency = value;
+    else if (name == "active") opts.active = value;
+    else if (name == "think") opts.think_ms = value;
+    else if (name == "payload") opts.payload = value;
+    else if (name == "hold") opts.hold_s = value;
+    else if (name == "drain") opts.drain_s = value;
+    else if (name == "timeout") opts.timeout_ms = value;
+    else if (name == "interval") opts.interval_ms = value;
+    else if (name == "threads") opts.threads = value;
+    else if (name == "pid") opts.pid = value;
+    else return false;
+  }
+  return have_proxy && opts.sessions && opts.concurrency &&
+    opts.active <= 100 && opts.timeout_ms && opts.interval_ms &&
+    opts.threads;
+}
+
+static const char* phase_name(int phase) {
+  switch (phase) {
+  case 0: return "ramp";
+  case 1: return "hold";
+  case 2: return "drain";
+  default: return "?";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  options opts;
+  if (!parse_options(argc, argv, opts)) {
+    cerr << "Usage: conn_storm --proxy=ip:port [--type=socks5|https] "
+      "[--target=ip:port]\n"
+      "  [--sessions=N] [--concurrency=N] [--active=PERCENT] [--think=MS]\n"
+      "  [--payload=N] [--hold=S] [--drain=S] [--timeout=MS] "
+      "[--interval=MS]\n"
+      "  [--threads=N] [--pid=N]\n";
+    return 1;
+  }
+
+  io_context echo_ioc;
+  unique_ptr<echo_server> echo;
+  std::thread echo_thread;
+  tcp::endpoint target = opts.target;
+  if (target.port() == 0) {
+    echo.reset(new echo_server(echo_ioc));
+    target = echo->endpoint();
+    echo_thread = std::thread([&]() { echo_ioc.run(); });
+  }
+
+  vector<unique_ptr<storm_thread>> threads;
+  for (unsigned t = 0; t < opts.threads; t++) {
+    const size_t n = opts.sessions / opts.threads +
+      (t < opts.sessions % opts.threads);
+    const size_t c = std::max<size_t>(1, opts.concurrency / opts.threads);
+    threads.push_back(unique_ptr<storm_thread>(
+      new storm_thread(opts, target, n, c, 12345 + t)));
+  }
+
+  cout << "{\n";
+  cout << "  \"options\": {\"proxy\": \"" << opts.proxy <<
+    "\", \"type\": \"" << (opts.type == eSocks5 ? "socks5" : "https") <<
+    "\", \"sessions\": " << opts.sessions <<
+    ", \"concurrency\": " << opts.concurrency <<
+    ", \"active_percent\": " << opts.active <<
+    ", \"think_ms\": " << opts.think_ms <<
+    ", \"payload\": " << opts.payload <<
+    ", \"hold_s\": " << opts.hold_s <<
+    ", \"threads\": " << opts.threads <<
+    ", \"pid\": " << opts.pid << "},\n";
+  cout << "  \"samples\": [";
+
+  const auto t0 = steady_clock::now();
+  for (size_t t = 0; t < threads.size(); t++) {
+    threads[t]->start();
+  }
+
+  vector<double> all_accept_us, all_handshake_us;
+  process_sample peak = {0, 0};
+  process_sample last = {0, 0};
+  double ramp_secs = 0;
+  size_t peak_established = 0;
+  int phase = 0;
+  auto phase_start = t0;
+  auto next_sample = t0;
+  bool first = true;
+  cerr << "ramp\n";
+
+  for (;;) {
+    next_sample += chrono::milliseconds(opts.interval_ms);
+    this_thread::sleep_until(next_sample);
+    const auto now = steady_clock::now();
+
+    size_t established = 0, handshaking = 0, failed = 0, dropped = 0;
+    size_t pings = 0;
+    bool ramp_done = true;
+    vector<double> accept_us, handshake_us;
+    for (size_t t = 0; t < threads.size(); t++) {
+      storm_thread& st = *threads[t];
+      established += st.established_;
+      handshaking += st.handshaking_;
+      failed += st.failed_;
+      dropped += st.dropped_;
+      pings += st.pings_.exchange(0);
+      ramp_done = ramp_done && st.ramp_done();
+      st.take_latencies(accept_us, handshake_us);
+    }
+    all_accept_us.insert(all_accept_us.end(), accept_us.begin(),
+      accept_us.end());
+    all_handshake_us.insert(all_handshake_us.end(), handshake_us.begin(),
+      handshake_us.end());
+    peak_established = std::max(peak_established, established);
+
+    process_sample ps = {0, 0};
+    if (sample_process(opts.pid, ps)) {
+      last = ps;
+      peak.rss_kb = std::max(peak.rss_kb, ps.rss_kb);
+      peak.fds = std::max(peak.fds, ps.fds);
+    }
+
+    const double t_ms =
+      chrono::duration<double, milli>(now - t0).count();
+    const double interval_s = opts.interval_ms / 1000.0;
+    cout << (first ? "\n" : ",\n") << fixed << setprecision(1);
+    cout << "    {\"t_ms\": " << t_ms <<
+      ", \"phase\": \"" << phase_name(phase) << "\"" <<
+      ", \"open\": " << established <<
+      ", \"handshaking\": " << handshaking <<
+      ", \"failed\": " << failed <<
+      ", \"dropped\": " << dropped <<
+      ", \"pings_per_sec\": " << pings / interval_s <<
+      ", \"accepts\": " << accept_us.size() <<
+      ", \"accept_p50_us\": " << percentile(accept_us, 0.50) <<
+      ", \"accept_p99_us\": " << percentile(accept_us, 0.99) <<
+      ", \"handshake_p50_us\": " << percentile(handshake_us, 0.50) <<
+      ", \"handshake_p99_us\": " << percentile(handshake_us, 0.99) <<
+      ", \"rss_kb\": " << ps.rss_kb <<
+      ", \"fds\": " << ps.fds << "}";
+    cout.flush();
+    first = false;
+
+    const double in_phase =
+      chrono::duration<double>(now - phase_start).count();
+    if (phase == 0 && ramp_done) {
+      ramp_secs = chrono::duration<double>(now - t0).count();
+      phase = 1;
+      phase_start = now;
+      cerr << "hold, " << established << " open, " << failed <<
+        " failed\n";
+    }
+    else if (phase == 1 && in_phase >= opts.hold_s) {
+      for (size_t t = 0; t < threads.size(); t++) {
+        threads[t]->stop();
+      }
+      phase = 2;
+      phase_start = now;
+      cerr << "drain\n";
+    }
+    else if (phase == 2 && in_phase >= opts.drain_s) {
+      break;
+    }
+  }
+
+  for (size_t t = 0; t < threads.size(); t++) {
+    threads[t]->join();
+  }
+  size_t failed = 0, dropped = 0;
+  for (size_t t = 0; t < threads.size(); t++) {
+    failed += threads[t]->failed_;
+    dropped += threads[t]->dropped_;
+  }
+
+  cout << "\n  ],\n" << fixed << setprecision(1);
+  cout << "  \"summary\": {\"ramp_s\": " << ramp_secs <<
+    ", \"peak_open\": " << peak_established <<
+    ", \"failed\": " << failed <<
+    ", \"dropped\": " << dropped <<
+    ", \"accept_p50_us\": " << percentile(all_accept_us, 0.50) <<
+    ", \"accept_p99_us\": " << percentile(all_accept_us, 0.99) <<
+    ", \"handshake_p50_us\": " << percentile(all_handshake_us, 0.50) <<
+    ", \"handshake_p99_us\": " << percentile(all_handshake_us, 0.99) <<
+    ", \"peak_rss_kb\": " << peak.rss_kb <<
+    ", \"peak_fds\": " << peak.fds <<
+    ", \"final_rss_kb\": " << last.rss_kb <<
+    ", \"final_fds\": " << last.fds << "}\n}\n";
+
+  if (echo) {
+    echo_ioc.stop();
+    echo_thread.join();
+  }
+  return 0;
+}
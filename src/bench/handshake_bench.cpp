@@ -0,0 +1,248 @@
+// Runs proxy handshakes over loopback connections with each handshake
+// engine and reports handshakes per second and heap allocations per
+// handshake. Connections are set up outside the timed region, so only the
+// protocol exchange is measured.
+//
+// handshake_bench [num_handshakes]
+
+#include "proxy/client_session.h"
+#include "proxy/server_session.h"
+#include "proxy/handshake_engine.h"
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+// Allocations are counted only while |g_counting| is set.
+static atomic<bool> g_counting(false);
+static atomic<size_t> g_allocs(0);
+
+void* operator new(size_t size) {
+  if (g_counting.load(memory_order_relaxed)) {
+    g_allocs.fetch_add(1, memory_order_relaxed);
+  }
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static const size_t kBatchSize = 256;
+
+static const char kHttpsRequest[] =
+  "CONNECT example.com:443 HTTP/1.1\r\n"
+  "Host: example.com:443\r\n"
+  "\r\n";
+
+static const char kHttpsResponse[] =
+  "HTTP/1.1 200 Connection established\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+struct socket_pair {
+  tcp::socket client;
+  tcp::socket server;
+
+  socket_pair(boost::asio::io_context& ioc): client(ioc), server(ioc)
+  {
+  }
+};
+
+// One handshake: the server session reads the request and answers it.
+// The client side is a client_session for socks5 or fixed text for https.
+struct handshake {
+  unique_ptr<proxy::server_session> server;
+  unique_ptr<proxy::client_session> client;
+  proxy::destination                dst;
+  proxy::connect_response           resp;
+  char                              https_resp[sizeof(kHttpsResponse) - 1];
+};
+
+struct result {
+  double seconds;
+  size_t allocs;
+  size_t done;
+};
+
+static void make_pairs(boost::asio::io_context& ioc, tcp::acceptor& acc,
+  vector<unique_ptr<socket_pair>>& pairs)
+{
+  pairs.clear();
+  for (size_t i = 0; i < kBatchSize; i++) {
+    unique_ptr<socket_pair> sp(new socket_pair(ioc));
+    sp->client.connect(acc.local_endpoint());
+    acc.accept(sp->server);
+    sp->client.set_option(tcp::no_delay(true));
+    sp->server.set_option(tcp::no_delay(true));
+    pairs.push_back(move(sp));
+  }
+}
+
+static void start(handshake& h, socket_pair& sp,
+  proxy::server_session::proxy_type type, proxy::handshake_engine engine,
+  size_t& done)
+{
+  h.server.reset(proxy::create_server_session(sp.server, type, "", engine));
+  handshake* ph = &h;
+
+  h.server->read_connect_request(h.dst,
+    [ph](boost::system::error_code err) {
+      if (err) {
+        return;
+      }
+      ph->server->write_connect_response(
+        proxy::connect_response(proxy::connect_response::eSucceeded),
+        [](boost::system::error_code) {});
+    });
+
+  if (type == proxy::server_session::eSocks5) {
+    h.client.reset(proxy::create_client_session(sp.client,
+      proxy::client_session::eSocks5, proxy::credentials(), "", engine));
+
+    proxy::destination dst;
+    dst.hostname = "example.com";
+    dst.port = 443;
+    h.client->write_connect_request(dst,
+      [ph, &done](boost::system::error_code err) {
+        if (err) {
+          return;
+        }
+        ph->client->read_connect_response(ph->resp,
+          [ph, &done](boost::system::error_code err) {
+            if (!err &&
+                ph->resp.major == proxy::connect_response::eSucceeded)
+            {
+              done++;
+            }
+          });
+      });
+  }
+  else {
+    tcp::socket* client = &sp.client;
+    boost::asio::async_write(*client,
+      boost::asio::buffer(kHttpsRequest, sizeof(kHttpsRequest) - 1),
+      [ph, client, &done](boost::system::error_code err, size_t) {
+        if (err) {
+          return;
+        }
+        boost::asio::async_read(*client,
+          boost::asio::buffer(ph->https_resp),
+          [&done](boost::system::error_code err, size_t) {
+            if (!err) {
+              done++;
+            }
+          });
+      });
+  }
+}
+
+static result run(proxy::server_session::proxy_type type,
+  proxy::handshake_engine engine, size_t num)
+{
+  boost::asio::io_context ioc;
+  tcp::acceptor acc(ioc, tcp::endpoint(
+    boost::asio::ip::address_v4::loopback(), 0));
+
+  result res = {0, 0, 0};
+  vector<unique_ptr<socket_pair>> pairs;
+  vector<handshake> hs(kBatchSize);
+
+  for (size_t remaining = num; remaining > 0; ) {
+    const size_t n = remaining < kBatchSize ? remaining : kBatchSize;
+    make_pairs(ioc, acc, pairs);
+
+    g_allocs = 0;
+    g_counting = true;
+    auto t0 = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < n; i++) {
+      start(hs[i], *pairs[i], type, engine, res.done);
+    }
+    ioc.restart();
+    ioc.run();
+
+    auto t1 = chrono::steady_clock::now();
+    g_counting = false;
+
+    res.seconds += chrono::duration<double>(t1 - t0).count();
+    res.allocs += g_allocs;
+
+    for (size_t i = 0; i < n; i++) {
+      hs[i].server.reset();
+      hs[i].client.reset();
+    }
+    remaining -= n;
+  }
+  return res;
+}
+
+int main(int argc, char* argv[]) {
+  const size_t num = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+
+  struct engine_desc {
+    proxy::handshake_engine engine;
+    const char*             name;
+  };
+  vector<engine_desc> engines;
+  engines.push_back({proxy::eCallbackEngine, "callback"});
+  if (proxy::have_coroutine_engine()) {
+    engines.push_back({proxy::eCoroutineEngine, "coroutine"});
+  }
+  else {
+    cout << "coroutine engine is not built (PROXYSWISS_CORO_ENGINES=OFF)"
+      << endl;
+  }
+
+  struct proto_desc {
+    proxy::server_session::proxy_type type;
+    const char*                       name;
+  };
+  const proto_desc protos[] = {
+    {proxy::server_session::eSocks5, "socks5"},
+    {proxy::server_session::eHttps, "https"}
+  };
+
+  cout << num << " handshakes, batches of " << kBatchSize << endl;
+  cout << left << setw(8) << "proto" << setw(11) << "engine"
+    << right << setw(14) << "handshakes/s" << setw(14) << "allocs/hs"
+    << endl;
+
+  for (const proto_desc& proto : protos) {
+    for (const engine_desc& e : engines) {
+      const result res = run(proto.type, e.engine, num);
+      if (res.done != num) {
+        cout << proto.name << "/" << e.name << ": " << (num - res.done)
+          << " handshakes failed" << endl;
+      }
+      cout << left << setw(8) << proto.name << setw(11) << e.name
+        << right << fixed << setprecision(0)
+        << setw(14) << (res.seconds > 0 ? res.done / res.seconds : 0)
+        << setprecision(2)
+        << setw(14) << (res.done ? double(res.allocs) / res.done : 0)
+        << endl;
+    }
+  }
+  return 0;
+}
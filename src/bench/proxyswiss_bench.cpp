@@ -0,0 +1,589 @@
+// Runs proxyswiss in-process over loopback and prints JSON results.
+//
+// Starts echo, sink and source servers, socks5 upstreams (proxyswiss
+// itself as a plain socks5 proxy), and the proxy under test in tunnel,
+// socks5 and https modes with 0..max-depth socks5 hops behind it. For each
+// combination it measures connections/s, handshake latency (connect to
+// the first echoed byte) and single- and multi-stream throughput in both
+// directions.
+//
+// proxyswiss_bench [--conns=N] [--concurrency=N] [--mbytes=N]
+//                  [--streams=N] [--threads=N] [--max-depth=N]
+
+#include "proxyswiss/config.h"
+#include "proxyswiss/server.h"
+
+#include "proxy/client_session.h"
+
+#include <boost/asio.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+using namespace std;
+using namespace boost::placeholders;
+using boost::asio::io_context;
+using boost::asio::ip::address_v4;
+using boost::asio::ip::tcp;
+
+typedef chrono::steady_clock steady_clock;
+
+static const size_t kChunkSize = 64 * 1024;
+
+// ---
+// Target servers
+
+enum target_kind {
+  eEcho,    //< writes back what it reads
+  eSink,    //< reads until eof, then shuts down its side
+  eSource   //< reads a 64-bit byte count, writes that much, shuts down
+};
+
+class target_conn: public boost::enable_shared_from_this<target_conn> {
+public:
+  target_conn(tcp::socket sock, target_kind kind)
+    : sock_(std::move(sock)), kind_(kind), remaining_(0)
+  {
+  }
+
+  void start() {
+    if (kind_ == eSource) {
+      boost::asio::async_read(sock_,
+        boost::asio::buffer(&remaining_, sizeof(remaining_)),
+        boost::bind(&target_conn::handle_read_count, shared_from_this(),
+          _1, _2));
+    }
+    else {
+      read();
+    }
+  }
+
+private:
+  void read() {
+    sock_.async_read_some(boost::asio::buffer(buf_),
+      boost::bind(&target_conn::handle_read, shared_from_this(), _1, _2));
+  }
+
+  void handle_read(boost::system::error_code err, size_t num_bytes) {
+    if (err) {
+      boost::system::error_code ec;
+      sock_.shutdown(tcp::socket::shutdown_send, ec);
+      return;
+    }
+    if (kind_ == eEcho) {
+      boost::asio::async_write(sock_, boost::asio::buffer(buf_, num_bytes),
+        boost::bind(&target_conn::handle_write, shared_from_this(), _1,
+          _2));
+    }
+    else {
+      read();
+    }
+  }
+
+  void handle_write(boost::system::error_code err, size_t) {
+    if (!err) {
+      read();
+    }
+  }
+
+  void handle_read_count(boost::system::error_code err, size_t) {
+    if (!err) {
+      write_more();
+    }
+  }
+
+  void write_more() {
+    if (remaining_ == 0) {
+      boost::system::error_code ec;
+      sock_.shutdown(tcp::socket::shutdown_send, ec);
+      return;
+    }
+    const size_t n = static_cast<size_t>(
+      std::min<uint64_t>(remaining_, sizeof(buf_)));
+    boost::asio::async_write(sock_, boost::asio::buffer(buf_, n),
+      boost::bind(&target_conn::handle_source_write, shared_from_this(),
+        _1, _2));
+  }
+
+  void handle_source_write(boost::system::error_code err,
+    size_t num_bytes)
+  {
+    if (!err) {
+      remaining_ -= num_bytes;
+      write_more();
+    }
+  }
+
+private:
+  tcp::socket  sock_;
+  target_kind  kind_;
+  uint64_t     remaining_;
+  char         buf_[kChunkSize];
+};
+
+class target_server {
+public:
+  target_server(io_context& ioc, target_kind kind)
+    : acceptor_(ioc, tcp::endpoint(address_v4::loopback(), 0)), kind_(kind)
+  {
+    accept();
+  }
+
+  tcp::endpoint endpoint() const { return acceptor_.local_endpoint(); }
+
+private:
+  void accept() {
+    acceptor_.async_accept(
+      [this](boost::system::error_code err, tcp::socket sock) {
+        if (err) {
+          return;
+        }
+        sock.set_option(tcp::no_delay(true), err);
+        boost::make_shared<target_conn>(std::move(sock), kind_)->start();
+        accept();
+      });
+  }
+
+private:
+  tcp::acceptor  acceptor_;
+  target_kind    kind_;
+};
+
+// ---
+// A proxyswiss server running on its own thread
+
+class proxy_instance {
+public:
+  explicit proxy_instance(const proxyswiss::config& cfg)
+    : cfg_(cfg), work_(ioc_.get_executor()), srv_(ioc_, cfg_)
+  {
+  }
+
+  ~proxy_instance() {
+    work_.reset();
+    ioc_.stop();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    srv_.stop();
+  }
+
+  bool start() {
+    boost::system::error_code err;
+    if (!srv_.open(err)) {
+      return false;
+    }
+    srv_.start();
+    thread_ = std::thread([this]() { ioc_.run(); });
+    return true;
+  }
+
+  tcp::endpoint endpoint() const { return srv_.local_endpoint(); }
+
+private:
+  proxyswiss::config  cfg_;
+  io_context          ioc_;
+  boost::asio::executor_work_guard<io_context::executor_type>  work_;
+  proxyswiss::server  srv_;
+  std::thread         thread_;
+};
+
+// ---
+// Client side
+
+enum mode {
+  eTunnel,
+  eSocks5,
+  eHttps
+};
+
+static const char* mode_name(mode m) {
+  switch (m) {
+  case eTunnel: return "tunnel";
+  case eSocks5: return "socks5";
+  case eHttps: return "https";
+  default: return "?";
+  }
+}
+
+// Connects to the proxy and, unless it is a tunnel, asks it for |dst|.
+static bool open_stream(io_context& ioc, tcp::socket& sock,
+  const tcp::endpoint& proxy_ep, mode m, const tcp::endpoint& dst)
+{
+  boost::system::error_code err;
+  sock.connect(proxy_ep, err);
+  if (err) {
+    return false;
+  }
+  sock.set_option(tcp::no_delay(true), err);
+
+  if (m == eSocks5) {
+    unique_ptr<proxy::client_session> cs(proxy::create_client_session(sock,
+      proxy::client_session::eSocks5, proxy::credentials(), "bench"));
+
+    proxy::connect_response resp;
+    bool ok = false;
+    cs->write_connect_request(
+      proxy::destination("", dst.address(), dst.port()),
+      [&](boost::system::error_code err) {
+        if (err) {
+          return;
+        }
+        cs->read_connect_response(resp,
+          [&](boost::system::error_code err) {
+            ok = !err &&
+              resp.major == proxy::connect_response::eSucceeded;
+          });
+      });
+    ioc.restart();
+    ioc.run();
+    return ok;
+  }
+
+  if (m == eHttps) {
+    const string host = dst.address().to_string() + ":" +
+      to_string(dst.port());
+    const string req = "CONNECT " + host + " HTTP/1.1\r\n"
+      "Host: " + host + "\r\n\r\n";
+    boost::asio::write(sock, boost::asio::buffer(req), err);
+    if (err) {
+      return false;
+    }
+    // Nothing follows the response until we send something.
+    boost::asio::streambuf resp;
+    boost::asio::read_until(sock, resp, "\r\n\r\n", err);
+    if (err) {
+      return false;
+    }
+    const char* p = boost::asio::buffer_cast<const char*>(resp.data());
+    return resp.size() >= 12 && !memcmp(p + 9, "200", 3);
+  }
+
+  return true;
+}
+
+struct handshake_result {
+  double  conns_per_sec;
+  double  p50_us;
+  double  p99_us;
+  size_t  failed;
+};
+
+static double percentile(const vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const size_t i = std::min(sorted.size() - 1,
+    static_cast<size_t>(p * sorted.size()));
+  return sorted[i];
+}
+
+// |conns| connections, |concurrency| at a time. Each one ends with a byte
+// echoed through the proxy.
+static handshake_result run_handshakes(const tcp::endpoint& proxy_ep,
+  mode m, const tcp::endpoint& echo_ep, size_t conns, size_t concurrency)
+{
+  vector<vector<double>> lat(concurrency);
+  atomic<size_t> failed(0);
+  vector<std::thread> threads;
+
+  const auto t0 = steady_clock::now();
+  for (size_t t = 0; t < concurrency; t++) {
+    const size_t n = conns / concurrency + (t < conns % concurrency);
+    threads.push_back(std::thread([&, t, n]() {
+      io_context ioc;
+      for (size_t i = 0; i < n; i++) {
+        const auto start = steady_clock::now();
+        tcp::socket sock(ioc);
+        char c = 'x';
+        boost::system::error_code err;
+        bool ok = open_stream(ioc, sock, proxy_ep, m, echo_ep);
+        if (ok) {
+          boost::asio::write(sock, boost::asio::buffer(&c, 1), err);
+          if (!err) {
+            boost::asio::read(sock, boost::asio::buffer(&c, 1), err);
+          }
+          ok = !err;
+        }
+        if (!ok) {
+          failed++;
+          continue;
+        }
+        lat[t].push_back(chrono::duration<double, micro>(
+          steady_clock::now() - start).count());
+      }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); t++) {
+    threads[t].join();
+  }
+  const double secs =
+    chrono::duration<double>(steady_clock::now() - t0).count();
+
+  vector<double> all;
+  for (size_t t = 0; t < lat.size(); t++) {
+    all.insert(all.end(), lat[t].begin(), lat[t].end());
+  }
+  sort(all.begin(), all.end());
+
+  handshake_result res;
+  res.conns_per_sec = secs > 0 ? all.size() / secs : 0;
+  res.p50_us = percentile(all, 0.50);
+  res.p99_us = percentile(all, 0.99);
+  res.failed = failed;
+  return res;
+}
+
+// Moves |total_bytes| through |streams| connections at once, to the sink
+// (upload) or from the source (download). Returns Gbit/s, 0 on failure.
+static double run_throughput(const tcp::endpoint& proxy_ep, mode m,
+  const tcp::endpoint& target_ep, bool upload, uint64_t total_bytes,
+  size_t streams)
+{
+  const uint64_t per_stream = total_bytes / streams;
+  atomic<size_t> ready(0);
+  atomic<bool> failed(false);
+  promise<void> go;
+  shared_future<void> go_future(go.get_future());
+  vector<std::thread> threads;
+
+  for (size_t s = 0; s < streams; s++) {
+    threads.push_back(std::thread([&]() {
+      io_context ioc;
+      tcp::socket sock(ioc);
+      const bool ok = open_stream(ioc, sock, proxy_ep, m, target_ep);
+      ready++;
+      go_future.wait();
+      if (!ok) {
+        failed = true;
+        return;
+      }
+
+      vector<char> buf(kChunkSize);
+      boost::system::error_code err;
+      uint64_t done = 0;
+      if (upload) {
+        while (done < per_stream && !err) {
+          const size_t n = static_cast<size_t>(
+            std::min<uint64_t>(per_stream - done, buf.size()));
+          done += boost::asio::write(sock, boost::asio::buffer(&buf[0], n),
+            err);
+        }
+        sock.shutdown(tcp::socket::shutdown_send, err);
+        // The sink shuts down its side after seeing everything.
+        while (!err) {
+          sock.read_some(boost::asio::buffer(buf), err);
+        }
+        if (done != per_stream) {
+          failed = true;
+        }
+      }
+      else {
+        uint64_t count = per_stream;
+        boost::asio::write(sock, boost::asio::buffer(&count, sizeof(count)),
+          err);
+        while (!err) {
+          done += sock.read_some(boost::asio::buffer(buf), err);
+        }
+        if (done != per_stream) {
+          failed = true;
+        }
+      }
+    }));
+  }
+
+  while (ready < streams) {
+    std::this_thread::yield();
+  }
+  const auto t0 = steady_clock::now();
+  go.set_value();
+  for (size_t s = 0; s < threads.size(); s++) {
+    threads[s].join();
+  }
+  const double secs =
+    chrono::duration<double>(steady_clock::now() - t0).count();
+
+  if (failed || secs <= 0) {
+    return 0;
+  }
+  return per_stream * streams * 8 / secs / 1e9;
+}
+
+// ---
+
+struct options {
+  unsigned conns;
+  unsigned concurrency;
+  unsigned mbytes;
+  unsigned streams;
+  unsigned threads;
+  unsigned max_depth;
+
+  options(): conns(2000), concurrency(8), mbytes(256), streams(8),
+    threads(1), max_depth(3)
+  {
+  }
+};
+
+static bool parse_options(int argc, char* argv[], options& opts) {
+  for (int i = 1; i < argc; i++) {
+    const string arg(argv[i]);
+    const size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == string::npos) {
+      return false;
+    }
+    const string name = arg.substr(2, eq - 2);
+    const unsigned value =
+      static_cast<unsigned>(strtoul(arg.c_str() + eq + 1, nullptr, 10));
+
+    if (name == "conns") opts.conns = value;
+    else if (name == "concurrency") opts.concurrency = value;
+    else if (name == "mbytes") opts.mbytes = value;
+    else if (name == "streams") opts.streams = value;
+    else if (name == "threads") opts.threads = value;
+    else if (name == "max-depth") opts.max_depth = value;
+    else return false;
+  }
+  return opts.conns && opts.concurrency && opts.mbytes && opts.streams &&
+    opts.threads;
+}
+
+static proxyswiss::config make_config(mode m, const tcp::endpoint& tunnel_to,
+  const vector<tcp::endpoint>& chain, unsigned threads)
+{
+  proxyswiss::config cfg;
+  cfg.input.listen_addr = tcp::endpoint(address_v4::loopback(), 0);
+  if (m == eTunnel) {
+    cfg.input.type = proxyswiss::config::eTunnel;
+    cfg.input.as_tunnel.destination =
+      proxy::destination("", tunnel_to.address(), tunnel_to.port());
+  }
+  else {
+    cfg.input.type = proxyswiss::config::eProxyServer;
+    cfg.input.as_proxy_server.proxy_server_type = m == eSocks5 ?
+      proxy::server_session::eSocks5 : proxy::server_session::eHttps;
+  }
+  for (size_t i = 0; i < chain.size(); i++) {
+    proxyswiss::config::proxy_client_info hop;
+    hop.proxy_client_type = proxy::client_session::eSocks5;
+    hop.proxy_address =
+      proxy::destination("", chain[i].address(), chain[i].port());
+    cfg.output.proxy_chain.push_back(hop);
+  }
+  cfg.server.num_threads = threads;
+  return cfg;
+}
+
+int main(int argc, char* argv[]) {
+  options opts;
+  if (!parse_options(argc, argv, opts)) {
+    cerr << "Usage: proxyswiss_bench [--conns=N] [--concurrency=N] "
+      "[--mbytes=N] [--streams=N] [--threads=N] [--max-depth=N]\n";
+    return 1;
+  }
+  opts.max_depth = std::min(opts.max_depth, 3u);
+
+  // Targets
+  io_context targets_ioc;
+  target_server echo(targets_ioc, eEcho);
+  target_server sink(targets_ioc, eSink);
+  target_server source(targets_ioc, eSource);
+  boost::asio::executor_work_guard<io_context::executor_type> targets_work(
+    targets_ioc.get_executor());
+  std::thread targets_thread([&]() { targets_ioc.run(); });
+
+  // Upstream socks5 hops
+  vector<unique_ptr<proxy_instance>> upstreams;
+  vector<tcp::endpoint> upstream_eps;
+  for (unsigned i = 0; i < opts.max_depth; i++) {
+    upstreams.push_back(unique_ptr<proxy_instance>(new proxy_instance(
+      make_config(eSocks5, tcp::endpoint(), vector<tcp::endpoint>(), 1))));
+    if (!upstreams.back()->start()) {
+      cerr << "Can't start upstream #" << i << "\n";
+      return 1;
+    }
+    upstream_eps.push_back(upstreams.back()->endpoint());
+  }
+
+  const uint64_t total_bytes = static_cast<uint64_t>(opts.mbytes) << 20;
+
+  cout << "{\n";
+  cout << "  \"options\": {\"conns\": " << opts.conns <<
+    ", \"concurrency\": " << opts.concurrency <<
+    ", \"mbytes\": " << opts.mbytes <<
+    ", \"streams\": " << opts.streams <<
+    ", \"threads\": " << opts.threads << "},\n";
+  cout << "  \"results\": [";
+
+  const mode modes[] = {eTunnel, eSocks5, eHttps};
+  bool first = true;
+  for (mode m : modes) {
+    for (unsigned depth = 0; depth <= opts.max_depth; depth++) {
+      cerr << mode_name(m) << ", depth " << depth << "\n";
+
+      const vector<tcp::endpoint> chain(upstream_eps.begin(),
+        upstream_eps.begin() + depth);
+
+      // A tunnel goes to one place, so each target needs its own.
+      proxy_instance to_echo(make_config(m, echo.endpoint(), chain,
+        opts.threads));
+      proxy_instance to_sink(make_config(m, sink.endpoint(), chain,
+        opts.threads));
+      proxy_instance to_source(make_config(m, source.endpoint(), chain,
+        opts.threads));
+      if (!to_echo.start() || !to_sink.start() || !to_source.start()) {
+        cerr << "Can't start proxyswiss\n";
+        return 1;
+      }
+
+      const handshake_result hs = run_handshakes(to_echo.endpoint(), m,
+        echo.endpoint(), opts.conns, opts.concurrency);
+
+      const double up1 = run_throughput(to_sink.endpoint(), m,
+        sink.endpoint(), true, total_bytes, 1);
+      const double down1 = run_throughput(to_source.endpoint(), m,
+        source.endpoint(), false, total_bytes, 1);
+      const double upn = run_throughput(to_sink.endpoint(), m,
+        sink.endpoint(), true, total_bytes, opts.streams);
+      const double downn = run_throughput(to_source.endpoint(), m,
+        source.endpoint(), false, total_bytes, opts.streams);
+
+      cout << (first ? "\n" : ",\n") << fixed << setprecision(1);
+      cout << "    {\"mode\": \"" << mode_name(m) << "\", \"depth\": " <<
+        depth <<
+        ", \"conns_per_sec\": " << hs.conns_per_sec <<
+        ", \"failed\": " << hs.failed <<
+        ", \"handshake_p50_us\": " << hs.p50_us <<
+        ", \"handshake_p99_us\": " << hs.p99_us <<
+        setprecision(3) <<
+        ", \"single_stream_up_gbps\": " << up1 <<
+        ", \"single_stream_down_gbps\": " << down1 <<
+        ", \"multi_stream_up_gbps\": " << upn <<
+        ", \"multi_stream_down_gbps\": " << downn << "}";
+      cout.flush();
+      first = false;
+    }
+  }
+  cout << "\n  ]\n}\n";
+
+  upstreams.clear();
+  targets_work.reset();
+  targets_ioc.stop();
+  targets_thread.join();
+  return 0;
+}
@@ -0,0 +1,154 @@
+// Pushes chunks through every relay mode over loopback connections and
+// counts the heap allocations of the relaying thread once the relay is
+// warmed up. Exits with 1 if any mode allocates in steady state.
+//
+// relay_alloc_check [num_chunks]
+
+#include "proxyswiss/config.h"
+#include "proxyswiss/detail/buffer_pool.h"
+#include "proxyswiss/detail/counters.h"
+#include "proxyswiss/detail/relay.h"
+#include "proxyswiss/detail/splice_relay.h"
+
+#include <boost/asio.hpp>
+#include <boost/make_shared.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+
+using namespace std;
+using boost::asio::ip::tcp;
+using boost::asio::io_context;
+
+// Allocations are counted only while |g_counting| is set, and only on the
+// thread running the relay. The driving thread allocates as it likes.
+static atomic<bool> g_counting(false);
+static atomic<size_t> g_allocs(0);
+static thread_local bool t_relay_thread = false;
+
+void* operator new(size_t size) {
+  if (t_relay_thread && g_counting.load(memory_order_relaxed)) {
+    g_allocs.fetch_add(1, memory_order_relaxed);
+  }
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static const size_t kChunkSize = 16 * 1024;
+// Lets the buffer pool fill and the copy relay settle on a size class.
+static const size_t kWarmupChunks = 200;
+
+// |a| connected to |b|, over loopback.
+static void connect_pair(tcp::socket& a, tcp::socket& b) {
+  tcp::acceptor acpt(b.get_executor(),
+    tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+  a.connect(acpt.local_endpoint());
+  acpt.accept(b);
+}
+
+// client -> in =relay=> out -> sink. Returns the allocations made while
+// |num_chunks| chunks went through after the warmup.
+static size_t run(proxyswiss::config::relay_mode mode, size_t num_chunks) {
+  io_context relay_ioc(1);
+  io_context driver_ioc;
+  tcp::socket client(driver_ioc), in(relay_ioc);
+  tcp::socket out(relay_ioc), sink(driver_ioc);
+  connect_pair(client, in);
+  connect_pair(out, sink);
+
+  proxyswiss::detail::buffer_pool pool;
+  proxyswiss::detail::padded_counter bytes;
+  proxyswiss::config::relay_t cfg_relay;
+  cfg_relay.mode = mode;
+
+  boost::shared_ptr<proxyswiss::detail::relay> r(
+    proxyswiss::detail::create_relay(cfg_relay, pool, in, out, bytes,
+      boost::make_shared<int>(0)));
+  r->start();
+  r.reset();
+
+  size_t allocs = 0;
+  // Blocking, one chunk at a time, so the relay sees the same traffic
+  // every round.
+  thread driver([&]() {
+    vector<char> chunk(kChunkSize, 'x'), back(kChunkSize);
+    for (size_t i = 0; i < kWarmupChunks + num_chunks; i++) {
+      if (i == kWarmupChunks) {
+        g_allocs = 0;
+        g_counting = true;
+      }
+      boost::asio::write(client, boost::asio::buffer(chunk));
+      boost::asio::read(sink, boost::asio::buffer(back));
+    }
+    g_counting = false;
+    allocs = g_allocs;
+
+    // The relay finishes on eof.
+    boost::system::error_code ec;
+    client.shutdown(tcp::socket::shutdown_send, ec);
+    char c;
+    sink.read_some(boost::asio::buffer(&c, 1), ec);
+  });
+
+  t_relay_thread = true;
+  relay_ioc.run();
+  t_relay_thread = false;
+  driver.join();
+
+  return allocs;
+}
+
+int main(int argc, char* argv[]) {
+  const size_t num = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000;
+
+  struct mode_desc {
+    proxyswiss::config::relay_mode mode;
+    const char*                    name;
+  };
+  const mode_desc modes[] = {
+    {proxyswiss::config::eRelayCopy, "copy"},
+    {proxyswiss::config::eRelayPipelined, "pipelined"},
+    {proxyswiss::config::eRelayParked, "parked"},
+#ifdef PROXYSWISS_HAVE_SPLICE
+    {proxyswiss::config::eRelaySplice, "splice"},
+#endif
+  };
+
+  cout << num << " chunks of " << kChunkSize / 1024 << " KiB after "
+    << kWarmupChunks << " to warm up" << endl;
+  cout << left << setw(11) << "mode" << right << setw(10) << "allocs"
+    << endl;
+
+  bool ok = true;
+  for (const mode_desc& m : modes) {
+    const size_t allocs = run(m.mode, num);
+    cout << left << setw(11) << m.name << right << setw(10) << allocs
+      << endl;
+    if (allocs) {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    cout << "FAILED: relaying allocates in steady state" << endl;
+    return 1;
+  }
+  return 0;
+}
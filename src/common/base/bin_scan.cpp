@@ -1,12 +1,30 @@
-
 #include "common/base/bin_scan.h"
 
 #include <memory.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+    defined(__i386__)
+#define BIN_SCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BIN_SCAN_TARGET_AVX2
+#define BIN_SCAN_CTZ(x) _tzcnt_u32(x)
+#else
+#define BIN_SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#define BIN_SCAN_CTZ(x) __builtin_ctz(x)
+#endif
+#endif
 
 namespace common {
+namespace detail {
 
-void* bin_scan(const void* mem, size_t mem_len,
-               const void* pat, size_t pat_len)
+// Inputs shorter than this go to the scalar kernel.
+static const size_t kMinSimdLen = 32;
+
+void* bin_scan_scalar(const void* mem, size_t mem_len,
+                      const void* pat, size_t pat_len)
 {
   if (mem_len < pat_len) {
     return 0;
@@ -21,4 +39,168 @@ void* bin_scan(const void* mem, size_t mem_len,
   return 0;
 }
 
+#ifdef BIN_SCAN_X86
+
+// Candidate positions are those where both the first and the last byte
+// of |pat| match; only they are checked with memcmp.
+
+void* bin_scan_sse2(const void* mem, size_t mem_len,
+                    const void* pat, size_t pat_len)
+{
+  if (mem_len < pat_len || pat_len < 2) {
+    return bin_scan_scalar(mem, mem_len, pat, pat_len);
+  }
+  const char* memc = static_cast<const char*>(mem);
+  const char* patc = static_cast<const char*>(pat);
+
+  const __m128i first = _mm_set1_epi8(patc[0]);
+  const __m128i last = _mm_set1_epi8(patc[pat_len-1]);
+
+  size_t i = 0;
+  for (; i + 16 + pat_len - 1 <= mem_len; i += 16) {
+    const __m128i block_first = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(memc + i));
+    const __m128i block_last = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(memc + i + pat_len - 1));
+
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                    _mm_cmpeq_epi8(block_last, last))));
+
+    while (mask) {
+      const unsigned bit = BIN_SCAN_CTZ(mask);
+      if (!memcmp(memc + i + bit + 1, patc + 1, pat_len - 2)) {
+        return const_cast<char*>(memc + i + bit);
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return bin_scan_scalar(memc + i, mem_len - i, pat, pat_len);
+}
+
+BIN_SCAN_TARGET_AVX2
+void* bin_scan_avx2(const void* mem, size_t mem_len,
+                    const void* pat, size_t pat_len)
+{
+  if (mem_len < pat_len || pat_len < 2) {
+    return bin_scan_scalar(mem, mem_len, pat, pat_len);
+  }
+  const char* memc = static_cast<const char*>(mem);
+  const char* patc = static_cast<const char*>(pat);
+
+  const __m256i first = _mm256_set1_epi8(patc[0]);
+  const __m256i last = _mm256_set1_epi8(patc[pat_len-1]);
+
+  size_t i = 0;
+  for (; i + 32 + pat_len - 1 <= mem_len; i += 32) {
+    const __m256i block_first = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(memc + i));
+    const __m256i block_last = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(memc + i + pat_len - 1));
+
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+      _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                       _mm256_cmpeq_epi8(block_last, last))));
+
+    while (mask) {
+      const unsigned bit = BIN_SCAN_CTZ(mask);
+      if (!memcmp(memc + i + bit + 1, patc + 1, pat_len - 2)) {
+        return const_cast<char*>(memc + i + bit);
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  // Less than 32 candidates left.
+  return bin_scan_sse2(memc + i, mem_len - i, pat, pat_len);
+}
+
+bool bin_scan_have_sse2() {
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool bin_scan_have_avx2() {
+#ifdef _MSC_VER
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[0] < 7) {
+    return false;
+  }
+  __cpuid(regs, 1);
+  const bool osxsave = (regs[2] & (1 << 27)) != 0;
+  const bool avx = (regs[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx) {
+    return false;
+  }
+  // The OS saves YMM registers ?
+  if ((_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#else // !BIN_SCAN_X86
+
+void* bin_scan_sse2(const void* mem, size_t mem_len,
+                    const void* pat, size_t pat_len)
+{
+  return bin_scan_scalar(mem, mem_len, pat, pat_len);
+}
+
+void* bin_scan_avx2(const void* mem, size_t mem_len,
+                    const void* pat, size_t pat_len)
+{
+  return bin_scan_scalar(mem, mem_len, pat, pat_len);
+}
+
+bool bin_scan_have_sse2() {
+  return false;
+}
+
+bool bin_scan_have_avx2() {
+  return false;
+}
+
+#endif // BIN_SCAN_X86
+
+typedef void* (*bin_scan_fn)(const void*, size_t, const void*, size_t);
+
+static bin_scan_fn select_kernel() {
+  if (bin_scan_have_avx2()) {
+    return &bin_scan_avx2;
+  }
+  if (bin_scan_have_sse2()) {
+    return &bin_scan_sse2;
+  }
+  return &bin_scan_scalar;
+}
+
+} // namespace detail
+
+void* bin_scan(const void* mem, size_t mem_len,
+               const void* pat, size_t pat_len)
+{
+  static const detail::bin_scan_fn kernel = detail::select_kernel();
+
+  if (mem_len < detail::kMinSimdLen) {
+    return detail::bin_scan_scalar(mem, mem_len, pat, pat_len);
+  }
+  if (pat_len == 1) {
+    return const_cast<void*>(memchr(mem, *static_cast<const char*>(pat),
+      mem_len));
+  }
+  return kernel(mem, mem_len, pat, pat_len);
+}
+
 }
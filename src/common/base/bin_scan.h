@@ -1,9 +1,27 @@
-
 #pragma once
 
+#include <stddef.h>
+
 namespace common {
 
+// Finds the first occurrence of |pat| in |mem|. Uses the widest SIMD
+// kernel the CPU supports (picked once, at first call).
 void* bin_scan(const void* mem, size_t mem_len,
                const void* pat, size_t pat_len);
 
+namespace detail {
+
+// The kernels, exposed for the benchmark.
+void* bin_scan_scalar(const void* mem, size_t mem_len,
+                      const void* pat, size_t pat_len);
+void* bin_scan_sse2(const void* mem, size_t mem_len,
+                    const void* pat, size_t pat_len);
+void* bin_scan_avx2(const void* mem, size_t mem_len,
+                    const void* pat, size_t pat_len);
+
+bool bin_scan_have_sse2();
+bool bin_scan_have_avx2();
+
+}
+
 }
@@ -2,6 +2,7 @@
 #include "proxy/client_session.h"
 
 #include "proxy/detail/client_session_socks5.h"
+#include "proxy/detail/client_session_socks5_coro.h"
 
 #include <assert.h>
 
@@ -13,12 +14,25 @@ client_session* create_client_session(
   boost::asio::ip::tcp::socket& sock,
   client_session::proxy_type type,
   const credentials& creds,
-  const string& dbglog_uid)
+  const string& dbglog_uid,
+  handshake_engine engine,
+  session_arena* arena)
 {
+#ifndef PROXY_HAVE_CORO_ENGINES
+  (void)engine;
+#endif
   client_session* ret = nullptr;
   switch (type) {
   case client_session::eSocks5:
-    ret = new detail::client_session_socks5(sock, creds);
+#ifdef PROXY_HAVE_CORO_ENGINES
+    if (engine == eCoroutineEngine) {
+      ret = session_arena::create<detail::client_session_socks5_coro>(arena,
+        sock, creds);
+      break;
+    }
+#endif
+    ret = session_arena::create<detail::client_session_socks5>(arena, sock,
+      creds);
     break;
   default:
     assert(0);
@@ -4,6 +4,8 @@
 #include "proxy/destination.h"
 #include "proxy/credentials.h"
 #include "proxy/connect_response.h"
+#include "proxy/handshake_engine.h"
+#include "proxy/session_arena.h"
 
 #include <boost/asio.hpp>
 
@@ -22,42 +24,71 @@ public:
   typedef boost::asio::ip::tcp::socket socket;
 
   // error_code can be one of proxy::error::basic_errors
+  typedef std::function<void(error_code)> auth_handler;
   typedef std::function<void(error_code)> write_request_handler;
   typedef std::function<void(error_code)> read_response_handler;
 
   // ---
 
+  virtual ~client_session() {}
+
   // Conditions:
   //  1) no parallel reads and/or writes
   //  2) client_session instance must exist until all handlers are called
 
+  // Optional. Does only the authentication part of the handshake, so a
+  // connection can be made ready before the destination is known.
+  virtual void authenticate(auth_handler handler) = 0;
+
+  // Authenticates first unless authenticated() already.
   virtual void write_connect_request(destination dst,
     write_request_handler handler) = 0;
 
   virtual void read_connect_response(connect_response& conn_resp,
     read_response_handler handler) = 0;
 
+  bool authenticated() const { return authenticated_; }
+
+  // The connection has been authenticated by another client_session
+  // (e.g. taken from a connection pool).
+  void set_authenticated() { authenticated_ = true; }
+
+  // Optimistic mode: if not authenticated() yet, write_connect_request()
+  // sends the whole handshake (the auth method known from the credentials,
+  // the credentials, the request) at once, and read_connect_response()
+  // parses the auth replies before the response. Saves the auth round
+  // trips, but not every proxy accepts data before its replies.
+  void set_optimistic(bool optimistic) { optimistic_ = optimistic; }
+
 protected:
   client_session(socket& sock, const credentials& creds)
     :
     sock_(sock),
-    creds_(creds)
+    creds_(creds),
+    authenticated_(false),
+    optimistic_(false)
   {
   }
 
 protected:
   socket&           sock_;
   credentials       creds_;
+  bool              authenticated_;
+  bool              optimistic_;
 
 public:
   std::string dbglog_uid_; //< Used to track messages in debug log.
 };
 
+// With |arena|, the session is created in it and must be released with
+// session_arena::destroy().
 client_session* create_client_session(
   boost::asio::ip::tcp::socket& sock,
   client_session::proxy_type type,
   const credentials& creds,
-  const std::string& dbglog_uid);
+  const std::string& dbglog_uid,
+  handshake_engine engine = eCallbackEngine,
+  session_arena* arena = nullptr);
 
 void enum_client_session_types(
   std::map<client_session::proxy_type, std::wstring>& type_name_map);
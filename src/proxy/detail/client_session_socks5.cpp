@@ -27,7 +27,9 @@ client_session_socks5::client_session_socks5(socket& sock,
   :
   client_session(sock, creds),
   conn_read_packet_addr_(270),
-  puser_conn_resp_(nullptr)
+  auth_only_(false),
+  puser_conn_resp_(nullptr),
+  auth_replies_pending_(false)
 {
 }
 
@@ -41,6 +43,21 @@ void client_session_socks5::call_and_clear_handler(
   handler_copy(err);
 }
 
+void client_session_socks5::authenticate(auth_handler handler) {
+  assert(!authenticated_);
+
+  if (creds_.username.length() > 255 || creds_.password.length() > 255) {
+    handler(proxy::error::make_error_code(proxy::error::creds_too_long));
+    return;
+  }
+
+  // The auth steps report to |user_write_req_handler_|.
+  auth_only_ = true;
+  user_write_req_handler_ = handler;
+
+  auth_write_req();
+}
+
 void client_session_socks5::write_connect_request(
   destination dst,
   write_request_handler handler)
@@ -58,12 +75,31 @@ void client_session_socks5::write_connect_request(
   user_dst_ = dst;
   user_write_req_handler_ = handler;
 
-  auth_write_req();
+  if (authenticated_) {
+    conn_write_req();
+  }
+  else if (optimistic_) {
+    optimistic_write_req();
+  }
+  else {
+    auth_write_req();
+  }
 }
 
-void client_session_socks5::auth_write_req() {
-  write_buf_.clear();
-  common::bin_writer binw(write_buf_);
+void client_session_socks5::auth_complete() {
+  authenticated_ = true;
+
+  if (auth_only_) {
+    auth_only_ = false;
+    call_and_clear_handler(user_write_req_handler_, kNoError);
+    return;
+  }
+
+  conn_write_req();
+}
+
+void client_session_socks5::append_auth_req(common::bin_writer& binw) const
+{
   binw.write_uint8(5); // VER
   binw.write_uint8(1); // NMETHODS
 
@@ -73,6 +109,12 @@ void client_session_socks5::auth_write_req() {
   else {
     binw.write_uint8(2); // USERNAME/PASSWORD
   }
+}
+
+void client_session_socks5::auth_write_req() {
+  write_buf_.clear();
+  common::bin_writer binw(write_buf_);
+  append_auth_req(binw);
 
   boost::asio::async_write(sock_, boost::asio::buffer(write_buf_),
     boost::bind(&client_session_socks5::auth_write_req_handler,
@@ -137,8 +179,8 @@ void client_session_socks5::auth_read_resp_handler(error_code err,
       return;
     }
 
-    dbgprint("[%s] OK, writing connect req\n", dbglog_uid_.c_str());
-    conn_write_req();
+    dbgprint("[%s] OK, no auth\n", dbglog_uid_.c_str());
+    auth_complete();
   }
   else {
     if (auth_read_packet_[1] != 2) { // METHOD == USERNAME/PASSWORD
@@ -152,17 +194,20 @@ void client_session_socks5::auth_read_resp_handler(error_code err,
   }
 }
 
-void client_session_socks5::auth_write_creds() {
-  write_buf_.clear();
-  common::bin_writer binw(write_buf_);
-
-  binw.write_uint8(0x05);                                           // VER  = SOCKS5
+void client_session_socks5::append_creds(common::bin_writer& binw) const {
+  binw.write_uint8(0x01);                                           // VER  = 1 (RFC 1929)
   binw.write_uint8(static_cast<uint8_t>(creds_.username.length())); // ULEN
   binw._write_raw(creds_.username.c_str(),                          // UNAME
     static_cast<uint32_t>(creds_.username.length()));
   binw.write_uint8(static_cast<uint8_t>(creds_.password.length())); // PLEN
   binw._write_raw(creds_.password.c_str(),                          // PASSWD
     static_cast<uint32_t>(creds_.password.length()));
+}
+
+void client_session_socks5::auth_write_creds() {
+  write_buf_.clear();
+  common::bin_writer binw(write_buf_);
+  append_creds(binw);
 
   boost::asio::async_write(sock_, boost::asio::buffer(write_buf_),
     boost::bind(&client_session_socks5::auth_write_creds_handler, this,
@@ -204,7 +249,8 @@ void client_session_socks5::auth_read_creds_reply_handler(
     return;
   }
 
-  if (auth_read_packet_[0] != 5) { // VER == SOCKS5
+  // VER of the subnegotiation is 1, some servers answer 5.
+  if (auth_read_packet_[0] != 1 && auth_read_packet_[0] != 5) {
     call_and_clear_handler(user_write_req_handler_,
       proxy::error::make_error_code(proxy::error::protocol_violation));
     return;
@@ -216,14 +262,12 @@ void client_session_socks5::auth_read_creds_reply_handler(
     return;
   }
 
-  dbgprint("[%s] auth succeeded, writing req\n", dbglog_uid_.c_str());
-  conn_write_req();
+  dbgprint("[%s] auth succeeded\n", dbglog_uid_.c_str());
+  auth_complete();
 }
 
-void client_session_socks5::conn_write_req()
+void client_session_socks5::append_conn_req(common::bin_writer& binw) const
 {
-  write_buf_.clear();
-  common::bin_writer binw(write_buf_);
   binw.write_uint8(0x05);                                 // VER  = SOCKS5
   binw.write_uint8(0x01);                                 // CMD  = CONNECT
   binw.write_uint8(0x00);                                 // RSV  = 0
@@ -251,12 +295,120 @@ void client_session_socks5::conn_write_req()
   }
 
   binw.write_uint16(htons(user_dst_.port));              // DST.PORT
+}
+
+void client_session_socks5::conn_write_req()
+{
+  write_buf_.clear();
+  common::bin_writer binw(write_buf_);
+  append_conn_req(binw);
+
+  boost::asio::async_write(sock_, boost::asio::buffer(write_buf_),
+    boost::bind(&client_session_socks5::conn_write_req_handler, this,
+      _1, _2));
+}
+
+// ---
+// Optimistic mode
+
+void client_session_socks5::optimistic_write_req() {
+  write_buf_.clear();
+  common::bin_writer binw(write_buf_);
+  append_auth_req(binw);
+  if (!creds_.empty()) {
+    append_creds(binw);
+  }
+  append_conn_req(binw);
+
+  // The auth replies are parsed by read_connect_response().
+  auth_replies_pending_ = true;
 
   boost::asio::async_write(sock_, boost::asio::buffer(write_buf_),
     boost::bind(&client_session_socks5::conn_write_req_handler, this,
       _1, _2));
 }
 
+void client_session_socks5::optimistic_read_auth_resp() {
+  boost::asio::async_read(sock_,
+    boost::asio::buffer(auth_read_packet_, 2),
+    boost::asio::transfer_exactly(2),
+    boost::bind(&client_session_socks5::optimistic_read_auth_resp_handler,
+      this, _1, _2));
+}
+
+void client_session_socks5::optimistic_read_auth_resp_handler(
+  error_code err, size_t)
+{
+  if (err) {
+    call_and_clear_handler(user_read_resp_handler_, err);
+    return;
+  }
+
+  if (auth_read_packet_[0] != 5) { // VER
+    call_and_clear_handler(user_read_resp_handler_,
+      proxy::error::make_error_code(proxy::error::protocol_violation));
+    return;
+  }
+
+  if (auth_read_packet_[1] == 0xff) { // METHOD == FAILED
+    call_and_clear_handler(user_read_resp_handler_,
+      proxy::error::make_error_code(proxy::error::bad_auth_method));
+    return;
+  }
+
+  // Only the method we offered can be selected.
+  if (auth_read_packet_[1] != (creds_.empty() ? 0 : 2)) {
+    call_and_clear_handler(user_read_resp_handler_,
+      proxy::error::make_error_code(proxy::error::protocol_violation));
+    return;
+  }
+
+  if (creds_.empty()) {
+    auth_replies_pending_ = false;
+    authenticated_ = true;
+    conn_read_resp();
+  }
+  else {
+    optimistic_read_creds_reply();
+  }
+}
+
+void client_session_socks5::optimistic_read_creds_reply() {
+  boost::asio::async_read(sock_,
+    boost::asio::buffer(auth_read_packet_, 2),
+    boost::asio::transfer_exactly(2),
+    boost::bind(&client_session_socks5::optimistic_read_creds_reply_handler,
+      this, _1, _2));
+}
+
+void client_session_socks5::optimistic_read_creds_reply_handler(
+  error_code err, size_t)
+{
+  if (err) {
+    call_and_clear_handler(user_read_resp_handler_, err);
+    return;
+  }
+
+  // VER of the subnegotiation is 1, some servers answer 5.
+  if (auth_read_packet_[0] != 1 && auth_read_packet_[0] != 5) {
+    call_and_clear_handler(user_read_resp_handler_,
+      proxy::error::make_error_code(proxy::error::protocol_violation));
+    return;
+  }
+
+  if (auth_read_packet_[1] != 0) { // STATUS == success
+    call_and_clear_handler(user_read_resp_handler_,
+      proxy::error::make_error_code(proxy::error::auth_failed));
+    return;
+  }
+
+  dbgprint("[%s] optimistic auth succeeded\n", dbglog_uid_.c_str());
+
+  auth_replies_pending_ = false;
+  authenticated_ = true;
+  conn_read_resp();
+}
+
 void client_session_socks5::conn_write_req_handler(error_code err,
   size_t)
 {
@@ -287,7 +439,12 @@ void client_session_socks5::read_connect_response(
   puser_conn_resp_ = &conn_resp;
   user_read_resp_handler_ = handler;
 
-  conn_read_resp();
+  if (auth_replies_pending_) {
+    optimistic_read_auth_resp();
+  }
+  else {
+    conn_read_resp();
+  }
 }
 
 void client_session_socks5::conn_read_resp() {
@@ -7,6 +7,10 @@
 #include <vector>
 #include <stdint.h>
 
+namespace common {
+class bin_writer;
+}
+
 namespace proxy {
 namespace detail {
 
@@ -14,6 +18,8 @@ class client_session_socks5: public client_session {
 public:
   client_session_socks5(socket& sock, const credentials& creds);
 
+  virtual void authenticate(auth_handler handler) override;
+
   virtual void write_connect_request(destination dst,
     write_request_handler handler) override;
 
@@ -29,6 +35,7 @@ private:
   void auth_write_creds_handler(error_code, size_t);
   void auth_read_creds_reply();
   void auth_read_creds_reply_handler(error_code, size_t);
+  void auth_complete();
 
   void conn_write_req();
   void conn_write_req_handler(error_code, size_t);
@@ -46,15 +53,28 @@ private:
 
   void conn_read_resp_addr_complete(error_code);
 
+  void optimistic_write_req();
+  void optimistic_read_auth_resp();
+  void optimistic_read_auth_resp_handler(error_code, size_t);
+  void optimistic_read_creds_reply();
+  void optimistic_read_creds_reply_handler(error_code, size_t);
+
+  void append_auth_req(common::bin_writer&) const;
+  void append_creds(common::bin_writer&) const;
+  void append_conn_req(common::bin_writer&) const;
+
   void call_and_clear_handler(write_request_handler&, error_code);
 
   static connect_response::major_code socks5_rep_to_major_code(uint8_t);
 
 private:
   write_request_handler user_write_req_handler_;
+  bool                  auth_only_;
   read_response_handler user_read_resp_handler_;
   destination           user_dst_;
   connect_response*     puser_conn_resp_;
+  // Optimistic mode: the auth replies precede the connect response.
+  bool                  auth_replies_pending_;
 
   std::string write_buf_;
   uint8_t auth_read_packet_[2];
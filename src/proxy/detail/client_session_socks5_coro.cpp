@@ -0,0 +1,333 @@
+#include "proxy/detail/client_session_socks5_coro.h"
+
+#ifdef PROXY_HAVE_CORO_ENGINES
+
+#include "proxy/detail/coro_spawn.h"
+#include "proxy/error.h"
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+
+#include <assert.h>
+#include <string.h>
+
+#define dbgprint(...) __noop
+
+// https://www.ietf.org/rfc/rfc1928.txt
+// https://www.ietf.org/rfc/rfc1929.txt
+
+using namespace std;
+using boost::asio::awaitable;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+
+namespace proxy {
+namespace detail {
+
+static const boost::system::error_code kNoError;
+
+static boost::system::error_code protocol_violation() {
+  return proxy::error::make_error_code(proxy::error::protocol_violation);
+}
+
+client_session_socks5_coro::client_session_socks5_coro(socket& sock,
+  const credentials& creds)
+  : client_session(sock, creds), auth_replies_pending_(false)
+{
+}
+
+void client_session_socks5_coro::authenticate(auth_handler handler) {
+  assert(!authenticated_);
+
+  if (creds_.username.length() > 255 || creds_.password.length() > 255) {
+    handler(proxy::error::make_error_code(proxy::error::creds_too_long));
+    return;
+  }
+
+  spawn_handshake(sock_, auth(), handler);
+}
+
+void client_session_socks5_coro::write_connect_request(
+  destination dst,
+  write_request_handler handler)
+{
+  if (creds_.username.length() > 255 || creds_.password.length() > 255) {
+    handler(proxy::error::make_error_code(proxy::error::creds_too_long));
+    return;
+  }
+
+  if (dst.using_hostname() && dst.hostname.length() > 255) {
+    handler(proxy::error::make_error_code(proxy::error::hostname_too_long));
+    return;
+  }
+
+  spawn_handshake(sock_, write_request(dst), handler);
+}
+
+void client_session_socks5_coro::read_connect_response(
+  connect_response& conn_resp,
+  read_response_handler handler)
+{
+  spawn_handshake(sock_, read_response(conn_resp), handler);
+}
+
+awaitable<boost::system::error_code> client_session_socks5_coro::auth() {
+  error_code err;
+  auto token = redirect_error(use_awaitable, err);
+
+  // VER, ULEN, UNAME, PLEN, PASSWD is the longest.
+  uint8_t buf[1 + 1 + 255 + 1 + 255];
+
+  buf[0] = 5;                        // VER
+  buf[1] = 1;                        // NMETHODS
+  buf[2] = creds_.empty() ? 0 : 2;   // NO AUTH or USERNAME/PASSWORD
+  co_await boost::asio::async_write(sock_, boost::asio::buffer(buf, 3),
+    token);
+  if (err) {
+    co_return err;
+  }
+
+  co_await boost::asio::async_read(sock_, boost::asio::buffer(buf, 2),
+    token);
+  if (err) {
+    co_return err;
+  }
+  if (buf[0] != 5) { // VER
+    dbgprint("[%s] bad proto in auth ({0x%02x)\n", dbglog_uid_.c_str(),
+      buf[0]);
+    co_return protocol_violation();
+  }
+  if (buf[1] == 0xff) { // METHOD == FAILED
+    co_return proxy::error::make_error_code(proxy::error::bad_auth_method);
+  }
+
+  if (creds_.empty()) {
+    if (buf[1] != 0) { // METHOD == NO AUTHENTICATION REQUIRED
+      co_return protocol_violation();
+    }
+    authenticated_ = true;
+    co_return kNoError;
+  }
+
+  if (buf[1] != 2) { // METHOD == USERNAME/PASSWORD
+    co_return protocol_violation();
+  }
+
+  const size_t len = put_creds(buf);
+  co_await boost::asio::async_write(sock_, boost::asio::buffer(buf, len),
+    token);
+  if (err) {
+    co_return err;
+  }
+
+  co_await boost::asio::async_read(sock_, boost::asio::buffer(buf, 2),
+    token);
+  if (err) {
+    co_return err;
+  }
+  if (buf[0] != 1 && buf[0] != 5) { // VER (some servers answer 5)
+    co_return protocol_violation();
+  }
+  if (buf[1] != 0) { // STATUS == success
+    co_return proxy::error::make_error_code(proxy::error::auth_failed);
+  }
+
+  dbgprint("[%s] auth succeeded\n", dbglog_uid_.c_str());
+
+  authenticated_ = true;
+  co_return kNoError;
+}
+
+// Reads what auth() reads, after the optimistic write.
+awaitable<boost::system::error_code>
+client_session_socks5_coro::read_auth_replies()
+{
+  error_code err;
+  auto token = redirect_error(use_awaitable, err);
+
+  uint8_t buf[2];
+  co_await boost::asio::async_read(sock_, boost::asio::buffer(buf), token);
+  if (err) {
+    co_return err;
+  }
+  if (buf[0] != 5) { // VER
+    co_return protocol_violation();
+  }
+  if (buf[1] == 0xff) { // METHOD == FAILED
+    co_return proxy::error::make_error_code(proxy::error::bad_auth_method);
+  }
+  // Only the method we offered can be selected.
+  if (buf[1] != (creds_.empty() ? 0 : 2)) {
+    co_return protocol_violation();
+  }
+
+  if (!creds_.empty()) {
+    co_await boost::asio::async_read(sock_, boost::asio::buffer(buf), token);
+    if (err) {
+      co_return err;
+    }
+    if (buf[0] != 1 && buf[0] != 5) { // VER (some servers answer 5)
+      co_return protocol_violation();
+    }
+    if (buf[1] != 0) { // STATUS == success
+      co_return proxy::error::make_error_code(proxy::error::auth_failed);
+    }
+  }
+
+  authenticated_ = true;
+  co_return kNoError;
+}
+
+// VER, ULEN, UNAME, PLEN, PASSWD, returns the length.
+size_t client_session_socks5_coro::put_creds(uint8_t* buf) const {
+  const size_t ulen = creds_.username.length();
+  const size_t plen = creds_.password.length();
+  size_t len = 0;
+  buf[len++] = 1;                                  // VER of the subnegotiation
+  buf[len++] = static_cast<uint8_t>(ulen);         // ULEN
+  memcpy(&buf[len], creds_.username.data(), ulen); // UNAME
+  len += ulen;
+  buf[len++] = static_cast<uint8_t>(plen);         // PLEN
+  memcpy(&buf[len], creds_.password.data(), plen); // PASSWD
+  len += plen;
+  return len;
+}
+
+awaitable<boost::system::error_code>
+client_session_socks5_coro::write_request(destination dst)
+{
+  // Greeting and credentials (optimistic mode), VER, CMD, RSV, ATYP,
+  // DST.ADDR (up to 1 + 255), DST.PORT
+  uint8_t buf[3 + (1 + 1 + 255 + 1 + 255) + 4 + 1 + 255 + 2];
+  size_t len = 0;
+
+  if (!authenticated_) {
+    if (optimistic_) {
+      buf[len++] = 5;                         // VER
+      buf[len++] = 1;                         // NMETHODS
+      buf[len++] = creds_.empty() ? 0 : 2;    // NO AUTH or USERNAME/PASSWORD
+      if (!creds_.empty()) {
+        len += put_creds(&buf[len]);
+      }
+      // The auth replies are read by read_response().
+      auth_replies_pending_ = true;
+    }
+    else {
+      const error_code auth_err = co_await auth();
+      if (auth_err) {
+        co_return auth_err;
+      }
+    }
+  }
+
+  buf[len++] = 5; // VER  = SOCKS5
+  buf[len++] = 1; // CMD  = CONNECT
+  buf[len++] = 0; // RSV  = 0
+
+  if (dst.using_hostname()) {
+    buf[len++] = 3; // ATYP = DOMAINNAME
+    buf[len++] = static_cast<uint8_t>(dst.hostname.length());
+    memcpy(&buf[len], dst.hostname.data(), dst.hostname.length());
+    len += dst.hostname.length();
+  }
+  else if (dst.ip_address.is_v4()) {
+    buf[len++] = 1; // ATYP = IP V4
+    const auto bytes = dst.ip_address.to_v4().to_bytes();
+    memcpy(&buf[len], bytes.data(), bytes.size());
+    len += bytes.size();
+  }
+  else {
+    buf[len++] = 4; // ATYP = IP V6
+    const auto bytes = dst.ip_address.to_v6().to_bytes();
+    memcpy(&buf[len], bytes.data(), bytes.size());
+    len += bytes.size();
+  }
+  buf[len++] = static_cast<uint8_t>(dst.port >> 8); // DST.PORT
+  buf[len++] = static_cast<uint8_t>(dst.port);
+
+  error_code err;
+  co_await boost::asio::async_write(sock_, boost::asio::buffer(buf, len),
+    redirect_error(use_awaitable, err));
+
+  co_return err;
+}
+
+awaitable<boost::system::error_code>
+client_session_socks5_coro::read_response(connect_response& conn_resp)
+{
+  if (auth_replies_pending_) {
+    auth_replies_pending_ = false;
+    const error_code auth_err = co_await read_auth_replies();
+    if (auth_err) {
+      co_return auth_err;
+    }
+  }
+
+  error_code err;
+  auto token = redirect_error(use_awaitable, err);
+
+  uint8_t hdr[4];
+  uint8_t addr[1 + 255 + 2];
+
+  // VER, REP, RSV, ATYP
+  co_await boost::asio::async_read(sock_, boost::asio::buffer(hdr), token);
+  if (err) {
+    co_return err;
+  }
+  if (hdr[0] != 5) { // VER == 5
+    dbgprint("[%s] bad proto in conn (ver={0x%02x})\n",
+      dbglog_uid_.c_str(), hdr[0]);
+    co_return protocol_violation();
+  }
+  if (hdr[1] > 8) { // REP in 0 .. 8
+    co_return protocol_violation();
+  }
+
+  // BND.ADDR, BND.PORT, they are not used.
+  switch (hdr[3]) { // ATYP ==
+  case 1: // IP V4
+    co_await boost::asio::async_read(sock_, boost::asio::buffer(addr, 6),
+      token);
+    break;
+  case 3: // DOMAINNAME
+    co_await boost::asio::async_read(sock_, boost::asio::buffer(addr, 1),
+      token);
+    if (!err) {
+      co_await boost::asio::async_read(sock_,
+        boost::asio::buffer(addr, addr[0] + 2), token);
+    }
+    break;
+  case 4: // IP V6
+    co_await boost::asio::async_read(sock_, boost::asio::buffer(addr, 18),
+      token);
+    break;
+  default:
+    co_return protocol_violation();
+  }
+  if (err) {
+    co_return err;
+  }
+
+  conn_resp = connect_response(socks5_rep_to_major_code(hdr[1]));
+  co_return kNoError;
+}
+
+connect_response::major_code
+client_session_socks5_coro::socks5_rep_to_major_code(uint8_t rep)
+{
+  // Some socks5 errors ('rep's) map to abstract eUnknownError.
+  switch (rep) {
+  case 0: return connect_response::eSucceeded;
+  case 4: return connect_response::eHostUnreachable;
+  case 5: return connect_response::eConnectionRefused;
+  case 8: return connect_response::eBadAddressType;
+  default:
+    return connect_response::eUnknownError;
+  }
+}
+
+}}
+
+#endif
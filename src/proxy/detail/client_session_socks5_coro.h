@@ -0,0 +1,46 @@
+#pragma once
+
+#include "proxy/client_session.h"
+
+#ifdef PROXY_HAVE_CORO_ENGINES
+
+#include <boost/asio/awaitable.hpp>
+
+#include <stdint.h>
+
+namespace proxy {
+namespace detail {
+
+// client_session_socks5 written as coroutines: each call runs as one
+// coroutine, the protocol state lives in its frame instead of members.
+class client_session_socks5_coro: public client_session {
+public:
+  client_session_socks5_coro(socket& sock, const credentials& creds);
+
+  virtual void authenticate(auth_handler handler) override;
+
+  virtual void write_connect_request(destination dst,
+    write_request_handler handler) override;
+
+  virtual void read_connect_response(connect_response& conn_resp,
+    read_response_handler handler) override;
+
+private:
+  boost::asio::awaitable<error_code> auth();
+  boost::asio::awaitable<error_code> read_auth_replies();
+  boost::asio::awaitable<error_code> write_request(destination dst);
+  boost::asio::awaitable<error_code> read_response(
+    connect_response& conn_resp);
+
+  size_t put_creds(uint8_t* buf) const;
+
+  static connect_response::major_code socks5_rep_to_major_code(uint8_t);
+
+private:
+  // Optimistic mode: the auth replies precede the connect response.
+  bool auth_replies_pending_;
+};
+
+}}
+
+#endif
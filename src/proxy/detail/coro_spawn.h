@@ -0,0 +1,52 @@
+#pragma once
+
+#ifdef PROXY_HAVE_CORO_ENGINES
+
+#include "proxy/error.h"
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/system/system_error.hpp>
+
+#include <exception>
+#include <new>
+#include <utility>
+
+namespace proxy {
+namespace detail {
+
+// What an exception out of a handshake coroutine is reported as.
+inline boost::system::error_code error_from_exception(std::exception_ptr e)
+{
+  try {
+    std::rethrow_exception(e);
+  }
+  catch (const boost::system::system_error& ex) {
+    return ex.code();
+  }
+  catch (const std::bad_alloc&) {
+    return boost::system::errc::make_error_code(
+      boost::system::errc::not_enough_memory);
+  }
+  catch (...) {
+    return proxy::error::make_error_code(proxy::error::internal_error);
+  }
+}
+
+// Runs |a| on the executor of |sock| and calls |handler| with its result.
+// An exception is passed on as an error_code; rethrown, it would leave
+// io_context::run() and end a worker thread with std::terminate().
+template <typename Handler>
+void spawn_handshake(boost::asio::ip::tcp::socket& sock,
+  boost::asio::awaitable<boost::system::error_code> a, Handler handler)
+{
+  boost::asio::co_spawn(sock.get_executor(), std::move(a),
+    [handler](std::exception_ptr e, boost::system::error_code err) {
+      handler(e ? error_from_exception(e) : err);
+    });
+}
+
+}}
+
+#endif
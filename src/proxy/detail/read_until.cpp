@@ -1,11 +1,14 @@
-
 #include "proxy/detail/read_until.h"
 
+#include "common/base/bin_scan.h"
+
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
+#include <algorithm>
+
 using namespace std;
 using namespace boost::asio::ip;
 using namespace boost::placeholders;
@@ -13,83 +16,103 @@ using namespace boost::placeholders;
 namespace proxy {
 namespace detail {
 
+static const size_t kReadChunkSize = 4096;
+
 class read_until_op: public boost::enable_shared_from_this<read_until_op> {
 public:
   typedef boost::system::error_code error_code;
   typedef boost::function<void(error_code)> handler_t;
 
-  read_until_op(tcp::socket& s, string& buf, const string& delim,
-    size_t max_chars, handler_t handler)
+  read_until_op(tcp::socket& s, string& rbuf, string& line,
+    const string& delim, size_t max_chars, handler_t handler)
     :
-    sock_(s), buf_(buf), delim_(delim), max_chars_(max_chars),
-    handler_(handler)
+    sock_(s), rbuf_(rbuf), line_(line), delim_(delim),
+    max_chars_(max_chars), handler_(handler), scanned_(0), read_len_(0)
   {
   }
 
   void start() {
-    buf_.clear();
-    read_next();
+    line_.clear();
+    scan();
   }
 
 private:
-  void read_next() {
+  // Looks for |delim_| in the bytes of |rbuf_| not scanned yet.
+  void scan() {
+    const size_t limit = std::min(rbuf_.length(), max_chars_);
+
+    if (limit >= delim_.length() && scanned_ + delim_.length() <= limit) {
+      const char* p = static_cast<const char*>(common::bin_scan(
+        rbuf_.data() + scanned_, limit - scanned_,
+        delim_.data(), delim_.length()));
+
+      if (p) {
+        size_t line_len = (p - rbuf_.data()) + delim_.length();
+        take_line(line_len);
+        return;
+      }
+      // The delimiter can start in the last |delim_.length()-1| bytes.
+      scanned_ = limit - delim_.length() + 1;
+    }
 
     // |max_chars_| is reached ?
-    if (buf_.length() == max_chars_) {
-      // Done
-      handler_(boost::system::error_code());
+    if (rbuf_.length() >= max_chars_) {
+      take_line(max_chars_);
       return;
     }
 
-    // |buf| ends with |delim| ?
-    if (buf_.length() >= delim_.length()
-        &&
-        !memcmp(&buf_.c_str()[buf_.length() - delim_.length()],
-                delim_.c_str(), delim_.length()))
-    {
-      // Done
-      handler_(boost::system::error_code());
-      return;
-    }
+    read_next();
+  }
+
+  void take_line(size_t len) {
+    line_.assign(rbuf_, 0, len);
+    rbuf_.erase(0, len);
+
+    // Done
+    handler_(boost::system::error_code());
+  }
 
-    // Allocate and read next char
-    size_t len = buf_.length();
-    buf_.resize(len + 1);
-    char* p = const_cast<char*>(&buf_.c_str()[len]);
+  void read_next() {
+    read_len_ = rbuf_.length();
+    rbuf_.resize(read_len_ + kReadChunkSize);
 
-    boost::asio::async_read(
-      sock_,
-      boost::asio::buffer(p, 1),
-      boost::asio::transfer_exactly(1),
+    sock_.async_read_some(
+      boost::asio::buffer(&rbuf_[read_len_], kReadChunkSize),
       boost::bind(&read_until_op::handle_read, shared_from_this(), _1, _2));
   }
 
-  void handle_read(error_code err, size_t) {
+  void handle_read(error_code err, size_t num_bytes) {
+    rbuf_.resize(read_len_ + (err ? 0 : num_bytes));
+
     if (err) {
       handler_(err);
       return;
     }
 
-    read_next();
+    scan();
   }
 
 private:
   tcp::socket&  sock_;
-  string&       buf_;
+  string&       rbuf_;
+  string&       line_;
   string        delim_;
   size_t        max_chars_;
   handler_t     handler_;
+  size_t        scanned_;
+  size_t        read_len_;
 };
 
 void read_until(
   tcp::socket& sock,
-  string& buf,
+  string& rbuf,
+  string& line,
   const string& delim,
   size_t max_chars,
   boost::function<void(boost::system::error_code)> handler)
 {
   boost::shared_ptr<read_until_op> sptr(new read_until_op(
-    sock, buf, delim, max_chars, handler));
+    sock, rbuf, line, delim, max_chars, handler));
 
   sptr->start();
 }
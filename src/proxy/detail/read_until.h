@@ -1,4 +1,3 @@
-
 #pragma once
 
 #include <boost/asio/ip/tcp.hpp>
@@ -9,9 +8,15 @@
 namespace proxy {
 namespace detail {
 
+// Moves the first |delim|-terminated piece of |rbuf| (delimiter included)
+// to |line|, reading more from |sock| into |rbuf| in large chunks when
+// needed. Bytes read past the delimiter stay in |rbuf| for the next call.
+// If no delimiter is found within |max_chars|, |line| gets the first
+// |max_chars| bytes without it.
 void read_until(
   boost::asio::ip::tcp::socket& sock,
-  std::string& buf,
+  std::string& rbuf,
+  std::string& line,
   const std::string& delim,
   size_t max_chars, // can be -1
   boost::function<void(boost::system::error_code)> handler);
@@ -23,7 +23,7 @@ static const boost::system::error_code kNoError;
 
 server_session_https::server_session_https(socket& sock)
   :
-  server_session(sock), puser_dst_(nullptr), http_ver_(eHttp10)
+  server_session(sock), http_ver_(eHttp10), puser_dst_(nullptr)
 {
 }
 
@@ -44,7 +44,7 @@ void server_session_https::read_connect_request(
 void server_session_https::read_line(
   boost::function<void(error_code)> handler)
 {
-  read_until(sock_, line_, "\n", kMaxLineLen, handler);
+  read_until(sock_, unread_, line_, "\n", kMaxLineLen, handler);
 }
 
 void server_session_https::read_first_line() {
@@ -24,18 +24,12 @@ public:
     const connect_response& conn_resp,
     write_response_handler handler) override;
 
-private:
+protected:
   enum http_version {
     eHttp10,
     eHttp11
   };
 
-  void read_line(boost::function<void(error_code)>);
-  void read_first_line();
-  void handle_read_first_line(error_code);
-  void read_another_line();
-  void handle_read_another_line(error_code);
-
   static error_code parse_first_line(const std::string&,
     proxy::destination&, http_version&);
 
@@ -43,6 +37,16 @@ private:
 
   static bool trim_line(std::string&);
 
+  std::string line_;
+  http_version http_ver_;
+
+private:
+  void read_line(boost::function<void(error_code)>);
+  void read_first_line();
+  void handle_read_first_line(error_code);
+  void read_another_line();
+  void handle_read_another_line(error_code);
+
   static bool major_to_http_code(connect_response::major_code,
     unsigned&, std::string&);
 
@@ -51,9 +55,7 @@ private:
 private:
   destination* puser_dst_;
   read_request_handler user_read_req_handler_;
-  std::string line_;
   destination parsed_dst_;
-  http_version http_ver_;
 };
 
 }}
@@ -0,0 +1,104 @@
+#include "proxy/detail/server_session_https_coro.h"
+
+#ifdef PROXY_HAVE_CORO_ENGINES
+
+#include "proxy/detail/coro_spawn.h"
+#include "proxy/error.h"
+
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <algorithm>
+
+using namespace std;
+using boost::asio::awaitable;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+
+namespace proxy {
+namespace detail {
+
+static const size_t kMaxLineLen = 2048;
+static const size_t kReadChunkSize = 4096;
+static const boost::system::error_code kNoError;
+
+server_session_https_coro::server_session_https_coro(socket& sock)
+  : server_session_https(sock)
+{
+}
+
+void server_session_https_coro::read_connect_request(
+  destination& dst, read_request_handler handler)
+{
+  spawn_handshake(sock_, read_request(dst), handler);
+}
+
+awaitable<boost::system::error_code>
+server_session_https_coro::read_request(destination& dst)
+{
+  destination parsed_dst;
+
+  error_code err = co_await read_line();
+  if (err) {
+    co_return err;
+  }
+  err = parse_first_line(line_, parsed_dst, http_ver_);
+  if (err) {
+    co_return err;
+  }
+
+  for (;;) {
+    err = co_await read_line();
+    if (err) {
+      co_return err;
+    }
+    if (line_.empty()) {
+      break;
+    }
+    err = verify_header_line(line_);
+    if (err) {
+      co_return err;
+    }
+  }
+
+  dst = parsed_dst;
+  co_return kNoError;
+}
+
+// Moves the next line from |unread_| to |line_| without its line break,
+// reading more when needed. Bytes past the line stay in |unread_|.
+awaitable<boost::system::error_code> server_session_https_coro::read_line()
+{
+  size_t scanned = 0;
+  for (;;) {
+    const size_t limit = std::min(unread_.length(), kMaxLineLen);
+    const size_t pos = unread_.find('\n', scanned);
+    if (pos != string::npos && pos < limit) {
+      line_.assign(unread_, 0, pos + 1);
+      unread_.erase(0, pos + 1);
+      trim_line(line_);
+      co_return kNoError;
+    }
+    if (unread_.length() >= kMaxLineLen) {
+      co_return proxy::error::make_error_code(proxy::error::line_too_long);
+    }
+    scanned = unread_.length();
+
+    const size_t old_len = unread_.length();
+    unread_.resize(old_len + kReadChunkSize);
+
+    error_code err;
+    const size_t num_bytes = co_await sock_.async_read_some(
+      boost::asio::buffer(&unread_[old_len], kReadChunkSize),
+      redirect_error(use_awaitable, err));
+
+    unread_.resize(old_len + (err ? 0 : num_bytes));
+    if (err) {
+      co_return err;
+    }
+  }
+}
+
+}}
+
+#endif
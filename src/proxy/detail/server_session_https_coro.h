@@ -0,0 +1,29 @@
+#pragma once
+
+#include "proxy/detail/server_session_https.h"
+
+#ifdef PROXY_HAVE_CORO_ENGINES
+
+#include <boost/asio/awaitable.hpp>
+
+namespace proxy {
+namespace detail {
+
+// server_session_https reading the CONNECT request in a coroutine. The
+// response is the same single write, so it is inherited.
+class server_session_https_coro: public server_session_https {
+public:
+  server_session_https_coro(socket& sock);
+
+  virtual void read_connect_request(
+    destination& dst,
+    read_request_handler handler) override;
+
+private:
+  boost::asio::awaitable<error_code> read_request(destination& dst);
+  boost::asio::awaitable<error_code> read_line();
+};
+
+}}
+
+#endif
@@ -1,11 +1,10 @@
-
 #include "proxy/detail/server_session_socks5.h"
 #include "proxy/error.h"
 
 #include <boost/bind/bind.hpp>
-#include <boost/array.hpp>
 
-#include <iostream>
+#include <algorithm>
+#include <array>
 #include <assert.h>
 
 // https://www.ietf.org/rfc/rfc1928.txt
@@ -18,9 +17,18 @@ namespace detail {
 
 static const boost::system::error_code kNoError;
 
+// Room for the longest request (4 + 1 + 255 + 2), read at once.
+static const size_t kReadChunkSize = 512;
+
+// Network order
+static uint16_t get_port(const uint8_t* p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
 server_session_socks5::server_session_socks5(socket& sock)
   :
-  server_session(sock), read_addr_(270), puser_dst_(nullptr)
+  server_session(sock), puser_dst_(nullptr), state_(eGreeting),
+  read_len_(0)
 {
 }
 
@@ -33,275 +41,192 @@ void server_session_socks5::read_connect_request(
 
   puser_dst_ = &dst;
   user_read_req_handler_ = handler;
+  state_ = eGreeting;
 
-  auth_read_req();
+  parse();
 }
 
-void server_session_socks5::auth_read_req() {
-  boost::asio::async_read(
-    sock_,
-    boost::asio::buffer(read_auth_hdr_, 2),
-    boost::asio::transfer_exactly(2),
-    boost::bind(&server_session_socks5::auth_read_req_handler, this,
-      _1, _2));
-}
-
-void server_session_socks5::auth_read_req_handler(error_code err,
-  size_t num_bytes)
-{
-  if (err) {
-    call_and_clear_handler(user_read_req_handler_, err);
+// Parses what is in |unread_|, goes to the socket only if the message
+// at its front is incomplete. Clients usually send each message in one
+// segment, often the request right behind the greeting.
+void server_session_socks5::parse() {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(unread_.data());
+  const size_t len = unread_.length();
+  size_t msg_len = 0;
+  error_code err;
+
+  switch (state_) {
+  case eGreeting:
+    if (!parse_greeting(p, len, msg_len, err)) {
+      read_more();
+      return;
+    }
+    if (err) {
+      call_and_clear_handler(user_read_req_handler_, err);
+      return;
+    }
+    unread_.erase(0, msg_len);
+    auth_write_resp();
     return;
-  }
 
-  if (read_auth_hdr_[0] != 5) { // VER == 5
-    call_and_clear_handler(
-      user_read_req_handler_,
-      proxy::error::make_error_code(proxy::error::protocol_violation));
+  case eRequest:
+    if (!parse_request(p, len, *puser_dst_, msg_len, err)) {
+      read_more();
+      return;
+    }
+    if (err) {
+      call_and_clear_handler(user_read_req_handler_, err);
+      return;
+    }
+    // Whatever follows belongs to the tunnel.
+    unread_.erase(0, msg_len);
+    puser_dst_ = nullptr;
+    call_and_clear_handler(user_read_req_handler_, kNoError);
     return;
-  }
 
-  if (read_auth_hdr_[1] == 0) { // NMETHODS != 1
-    call_and_clear_handler(user_read_req_handler_,
-      proxy::error::make_error_code(proxy::error::protocol_violation));
+  default:
+    assert(0);
     return;
   }
-
-  auth_read_req_methods();
 }
 
-void server_session_socks5::auth_read_req_methods() {
-  uint8_t nmethods = read_auth_hdr_[1];
-
-  read_auth_methods_ = vector<uint8_t>(nmethods);
+void server_session_socks5::read_more() {
+  read_len_ = unread_.length();
+  unread_.resize(read_len_ + kReadChunkSize);
 
-  boost::asio::async_read(
-    sock_,
-    boost::asio::buffer(read_auth_methods_, nmethods),
-    boost::asio::transfer_exactly(nmethods),
-    boost::bind(&server_session_socks5::auth_read_req_methods_handler,
-      this, _1, _2));
+  sock_.async_read_some(
+    boost::asio::buffer(&unread_[read_len_], kReadChunkSize),
+    boost::bind(&server_session_socks5::read_more_handler, this, _1, _2));
 }
 
-void server_session_socks5::auth_read_req_methods_handler(
-  error_code err, size_t num_bytes)
+void server_session_socks5::read_more_handler(error_code err,
+  size_t num_bytes)
 {
-  // Move |read_auth_methods_| from heap to stack.
-  vector<uint8_t> methods_copy(read_auth_methods_);
-  read_auth_methods_.clear();
+  unread_.resize(read_len_ + (err ? 0 : num_bytes));
 
   if (err) {
     call_and_clear_handler(user_read_req_handler_, err);
     return;
   }
 
-  // 'NO AUTH' method should present
-  static const uint8_t no_auth_method = 0;
-
-  auto it = std::find(methods_copy.begin(), methods_copy.end(),
-    no_auth_method);
-
-  if (it == methods_copy.end()) {
-    call_and_clear_handler(user_read_req_handler_,
-      proxy::error::make_error_code(proxy::error::protocol_violation));
-    return;
-  }
-
-  // Select 'NO AUTH' method.
-  auth_write_resp();
+  parse();
 }
 
-void server_session_socks5::auth_write_resp() {
-  write_auth_resp_[0] = 5; // VER
-  write_auth_resp_[1] = 0; // METHOD = NO AUTH
-
-  boost::asio::async_write(sock_,
-    boost::asio::buffer(write_auth_resp_),
-    boost::bind(&server_session_socks5::auth_write_resp_handler,
-      this, _1, _2));
-}
-
-void server_session_socks5::auth_write_resp_handler(error_code err,
-  size_t num_bytes)
+bool server_session_socks5::parse_greeting(const uint8_t* p, size_t len,
+  size_t& msg_len, error_code& err)
 {
-  if (err) {
-    call_and_clear_handler(user_read_req_handler_, err);
-    return;
+  // VER, NMETHODS, METHODS
+  if (len < 2) {
+    return false;
+  }
+  if (p[0] != 5) { // VER == 5
+    err = proxy::error::make_error_code(proxy::error::protocol_violation);
+    return true;
+  }
+  const size_t nmethods = p[1];
+  if (nmethods == 0) {
+    err = proxy::error::make_error_code(proxy::error::protocol_violation);
+    return true;
+  }
+  if (len < 2 + nmethods) {
+    return false;
   }
 
-  conn_read_req();
-}
+  // 'NO AUTH' method should present
+  const uint8_t* methods_end = p + 2 + nmethods;
+  if (std::find(p + 2, methods_end, 0) == methods_end) {
+    err = proxy::error::make_error_code(proxy::error::protocol_violation);
+    return true;
+  }
 
-void server_session_socks5::conn_read_req() {
-  boost::asio::async_read(
-    sock_,
-    boost::asio::buffer(read_conn_hdr_, 4),
-    boost::asio::transfer_exactly(4),
-    boost::bind(&server_session_socks5::conn_read_req_handler,
-      this, _1, _2));
+  msg_len = 2 + nmethods;
+  err = kNoError;
+  return true;
 }
 
-void server_session_socks5::conn_read_req_handler(error_code err,
-  size_t num_bytes)
+bool server_session_socks5::parse_request(const uint8_t* p, size_t len,
+  destination& dst, size_t& msg_len, error_code& err)
 {
-  if (err) {
-    call_and_clear_handler(user_read_req_handler_, err);
-    return;
+  // VER, CMD, RSV, ATYP, DST.ADDR, DST.PORT
+  if (len < 4) {
+    return false;
   }
-
-  if (read_conn_hdr_[0] != 5) { // VER == 5
-    call_and_clear_handler(user_read_req_handler_,
-      proxy::error::make_error_code(proxy::error::protocol_violation));
-    return;
+  if (p[0] != 5) { // VER == 5
+    err = proxy::error::make_error_code(proxy::error::protocol_violation);
+    return true;
   }
-
-  if (read_conn_hdr_[1] != 1) { // CMD == CONNECT
-    call_and_clear_handler(user_read_req_handler_,
-      proxy::error::make_error_code(proxy::error::unsupported_command));
-    return;
+  if (p[1] != 1) { // CMD == CONNECT
+    err = proxy::error::make_error_code(proxy::error::unsupported_command);
+    return true;
   }
 
-  switch (read_conn_hdr_[3]) { // ATYP ==
-  case 1:
-    conn_read_req_addr_ipv4();
+  switch (p[3]) { // ATYP ==
+  case 1: { // IP V4
+    if (len < 4 + 4 + 2) {
+      return false;
+    }
+    std::array<uint8_t, 4> addr;
+    std::copy(p + 4, p + 8, addr.begin());
+    dst.hostname = "";
+    dst.ip_address = boost::asio::ip::address_v4(addr);
+    dst.port = get_port(p + 8);
+    msg_len = 4 + 4 + 2;
     break;
-  case 3:
-    conn_read_req_addr_domainname();
-    break;
-  case 4:
-    conn_read_req_addr_ipv6();
+  }
+  case 3: { // DOMAINNAME
+    if (len < 5) {
+      return false;
+    }
+    const size_t str_len = p[4];
+    if (len < 5 + str_len + 2) {
+      return false;
+    }
+    dst.hostname.assign(reinterpret_cast<const char*>(p + 5), str_len);
+    dst.port = get_port(p + 5 + str_len);
+    msg_len = 5 + str_len + 2;
     break;
-  default:
-    call_and_clear_handler(user_read_req_handler_,
-      proxy::error::make_error_code(proxy::error::protocol_violation));
-    return;
   }
-}
-
-void server_session_socks5::conn_read_req_addr_ipv4() {
-  boost::asio::async_read(
-    sock_,
-    boost::asio::buffer(read_addr_, 6),
-    boost::asio::transfer_exactly(6),
-    boost::bind(
-      &server_session_socks5::conn_read_req_addr_ipv4_handler,
-      this, _1, _2));
-}
-
-void server_session_socks5::conn_read_req_addr_ipv4_handler(
-  error_code err, size_t num_bytes)
-{
-  if (err) {
-    call_and_clear_handler(user_read_req_handler_, err);
-    return;
+  case 4: { // IP V6
+    if (len < 4 + 16 + 2) {
+      return false;
+    }
+    std::array<uint8_t, 16> addr;
+    std::copy(p + 4, p + 20, addr.begin());
+    dst.hostname = "";
+    dst.ip_address = boost::asio::ip::address_v6(addr);
+    dst.port = get_port(p + 20);
+    msg_len = 4 + 16 + 2;
+    break;
   }
-
-  uint32_t addr32 = *reinterpret_cast<uint32_t*>(&read_addr_[0]);
-  uint16_t port16 = *reinterpret_cast<uint16_t*>(&read_addr_[4]);
-
-  puser_dst_->hostname = "";
-  puser_dst_->ip_address = boost::asio::ip::address_v4(htonl(addr32));
-  puser_dst_->port = htons(port16);
-
-  assert(!puser_dst_->using_hostname());
-
-  call_and_clear_handler(user_read_req_handler_, kNoError);
-
-  puser_dst_ = nullptr;
-}
-
-void server_session_socks5::conn_read_req_addr_domainname() {
-  // Read length (1 octet)
-  boost::asio::async_read(
-    sock_,
-    boost::asio::buffer(read_addr_, 1),
-    boost::asio::transfer_exactly(1),
-    boost::bind(
-      &server_session_socks5::conn_read_req_addr_domainname_handler,
-      this, _1, _2));
-}
-
-void server_session_socks5::conn_read_req_addr_domainname_handler(
-  error_code err, size_t num_bytes)
-{
-  if (err) {
-    call_and_clear_handler(user_read_req_handler_, err);
-    return;
+  default:
+    err = proxy::error::make_error_code(proxy::error::protocol_violation);
+    return true;
   }
 
-  conn_read_req_addr_domainname_str();
+  err = kNoError;
+  return true;
 }
 
-void server_session_socks5::conn_read_req_addr_domainname_str() {
-  uint8_t str_len = read_addr_[0];
-
-  // Read length (1 octet)
-  boost::asio::async_read(
-    sock_,
-    boost::asio::buffer(&read_addr_[1], str_len+2), // domainname+port
-    boost::asio::transfer_exactly(str_len +2),
-    boost::bind(
-     &server_session_socks5::conn_read_req_addr_domainname_str_handler,
-     this, _1, _2));
-}
-
-void server_session_socks5::conn_read_req_addr_domainname_str_handler(
-  error_code err, size_t num_bytes)
-{
-  if (err) {
-    call_and_clear_handler(user_read_req_handler_, err);
-    return;
-  }
-
-  uint8_t str_len = read_addr_[0];
-
-  puser_dst_->hostname = string(reinterpret_cast<char*>(&read_addr_[1]),
-    static_cast<size_t>(str_len));
-
-  puser_dst_->port = htons(
-    *reinterpret_cast<uint16_t*>(&read_addr_[str_len+1]));
-
-  assert(puser_dst_->using_hostname());
-
-  call_and_clear_handler(user_read_req_handler_, kNoError);
-
-  puser_dst_ = nullptr;
-}
+void server_session_socks5::auth_write_resp() {
+  write_auth_resp_[0] = 5; // VER
+  write_auth_resp_[1] = 0; // METHOD = NO AUTH
 
-void server_session_socks5::conn_read_req_addr_ipv6() {
-  boost::asio::async_read(
-    sock_,
-    boost::asio::buffer(&read_addr_[0], 18), // ipv6+port
-    boost::asio::transfer_exactly(18),
-    boost::bind(
-      &server_session_socks5::conn_read_req_addr_ipv6_handler,
+  boost::asio::async_write(sock_,
+    boost::asio::buffer(write_auth_resp_),
+    boost::bind(&server_session_socks5::auth_write_resp_handler,
       this, _1, _2));
 }
 
-void server_session_socks5::conn_read_req_addr_ipv6_handler(
-  error_code err, size_t num_bytes)
+void server_session_socks5::auth_write_resp_handler(error_code err,
+  size_t num_bytes)
 {
   if (err) {
     call_and_clear_handler(user_read_req_handler_, err);
     return;
   }
 
-  // No ideas.
-  const uint8_t* r = &read_addr_[0];
-  std::array<uint8_t, 16> addr_arr = {
-    r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], r[9], r[10],
-    r[11], r[12], r[13], r[14], r[15]
-  };
-
-  puser_dst_->hostname = "";
-  puser_dst_->ip_address = boost::asio::ip::address_v6(addr_arr);
-  puser_dst_->port = *reinterpret_cast<uint16_t*>(&read_addr_[16]);
-
-  assert(!puser_dst_->using_hostname());
-
-  call_and_clear_handler(user_read_req_handler_, kNoError);
-
-  puser_dst_ = nullptr;
+  state_ = eRequest;
+  parse();
 }
 
 // ---
@@ -345,9 +270,9 @@ uint8_t server_session_socks5::major_code_to_rep(
 {
   switch (mc) {
   case connect_response::eSucceeded: return 0;
-  case connect_response::eHostUnreachable: 4;
+  case connect_response::eHostUnreachable: return 4;
   case connect_response::eConnectionRefused: return 5;
-  case connect_response::eBadAddressType: return 7;
+  case connect_response::eBadAddressType: return 8;
   default:
   case connect_response::eUnknownError: return 1;
   }
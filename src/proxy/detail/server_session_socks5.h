@@ -24,23 +24,23 @@ public:
     write_response_handler handler) override;
 
 private:
-  void auth_read_req();
-  void auth_read_req_handler(error_code, size_t);
-  void auth_read_req_methods();
-  void auth_read_req_methods_handler(error_code, size_t);
+  enum state {
+    eGreeting,
+    eRequest
+  };
+
+  void parse();
+  void read_more();
+  void read_more_handler(error_code, size_t);
   void auth_write_resp();
   void auth_write_resp_handler(error_code, size_t);
 
-  void conn_read_req();
-  void conn_read_req_handler(error_code, size_t);
-  void conn_read_req_addr_ipv4();
-  void conn_read_req_addr_ipv4_handler(error_code, size_t);
-  void conn_read_req_addr_domainname();
-  void conn_read_req_addr_domainname_handler(error_code, size_t);
-  void conn_read_req_addr_domainname_str();
-  void conn_read_req_addr_domainname_str_handler(error_code, size_t);
-  void conn_read_req_addr_ipv6();
-  void conn_read_req_addr_ipv6_handler(error_code, size_t);
+  // Return false if the message is incomplete. Otherwise |err| tells if
+  // it is valid and |msg_len| is its length.
+  static bool parse_greeting(const uint8_t*, size_t len, size_t& msg_len,
+    error_code& err);
+  static bool parse_request(const uint8_t*, size_t len, destination&,
+    size_t& msg_len, error_code& err);
 
   void write_connect_response_handler(error_code, size_t);
 
@@ -53,11 +53,10 @@ private:
   read_request_handler user_read_req_handler_;
   write_response_handler user_write_resp_handler_;
 
-  uint8_t read_auth_hdr_[2];
-  std::vector<uint8_t> read_auth_methods_;
+  state state_;
+  size_t read_len_; //< |unread_| length before the pending read
+
   uint8_t write_auth_resp_[2];
-  uint8_t read_conn_hdr_[4];
-  std::vector<uint8_t> read_addr_;
   uint8_t write_conn_resp_[10];
 };
 
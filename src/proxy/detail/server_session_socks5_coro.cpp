@@ -0,0 +1,199 @@
+#include "proxy/detail/server_session_socks5_coro.h"
+
+#ifdef PROXY_HAVE_CORO_ENGINES
+
+#include "proxy/detail/coro_spawn.h"
+#include "proxy/error.h"
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+
+#include <algorithm>
+#include <array>
+
+#include <assert.h>
+#include <string.h>
+
+// https://www.ietf.org/rfc/rfc1928.txt
+
+using namespace std;
+using boost::asio::awaitable;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+
+namespace proxy {
+namespace detail {
+
+static const boost::system::error_code kNoError;
+
+static boost::system::error_code protocol_violation() {
+  return proxy::error::make_error_code(proxy::error::protocol_violation);
+}
+
+// Network order
+static uint16_t get_port(const uint8_t* p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+server_session_socks5_coro::server_session_socks5_coro(socket& sock)
+  : server_session(sock)
+{
+}
+
+void server_session_socks5_coro::read_connect_request(
+  destination& dst,
+  read_request_handler handler)
+{
+  spawn_handshake(sock_, read_request(dst), handler);
+}
+
+awaitable<boost::system::error_code>
+server_session_socks5_coro::read_request(destination& dst)
+{
+  error_code err;
+  auto token = redirect_error(use_awaitable, err);
+
+  // Big enough for any of the packets: 1 + 255 + 2 for a domain name.
+  uint8_t buf[262];
+
+  // VER, NMETHODS, METHODS
+  co_await boost::asio::async_read(sock_, boost::asio::buffer(buf, 2),
+    token);
+  if (err) {
+    co_return err;
+  }
+  if (buf[0] != 5 || buf[1] == 0) {
+    co_return protocol_violation();
+  }
+
+  const size_t nmethods = buf[1];
+  co_await boost::asio::async_read(sock_,
+    boost::asio::buffer(buf, nmethods), token);
+  if (err) {
+    co_return err;
+  }
+
+  // 'NO AUTH' method should present
+  if (find(buf, buf + nmethods, 0) == buf + nmethods) {
+    co_return protocol_violation();
+  }
+
+  // Select 'NO AUTH' method.
+  buf[0] = 5; // VER
+  buf[1] = 0; // METHOD = NO AUTH
+  co_await boost::asio::async_write(sock_, boost::asio::buffer(buf, 2),
+    token);
+  if (err) {
+    co_return err;
+  }
+
+  // VER, CMD, RSV, ATYP
+  co_await boost::asio::async_read(sock_, boost::asio::buffer(buf, 4),
+    token);
+  if (err) {
+    co_return err;
+  }
+  if (buf[0] != 5) {
+    co_return protocol_violation();
+  }
+  if (buf[1] != 1) { // CMD == CONNECT
+    co_return proxy::error::make_error_code(
+      proxy::error::unsupported_command);
+  }
+
+  switch (buf[3]) { // ATYP ==
+  case 1: { // IP V4
+    co_await boost::asio::async_read(sock_, boost::asio::buffer(buf, 6),
+      token);
+    if (err) {
+      co_return err;
+    }
+    array<uint8_t, 4> addr;
+    memcpy(addr.data(), buf, 4);
+    dst.hostname = "";
+    dst.ip_address = boost::asio::ip::address_v4(addr);
+    dst.port = get_port(&buf[4]);
+    break;
+  }
+  case 3: { // DOMAINNAME
+    co_await boost::asio::async_read(sock_, boost::asio::buffer(buf, 1),
+      token);
+    if (err) {
+      co_return err;
+    }
+    const size_t len = buf[0];
+    co_await boost::asio::async_read(sock_,
+      boost::asio::buffer(buf, len + 2), token);
+    if (err) {
+      co_return err;
+    }
+    dst.hostname.assign(reinterpret_cast<const char*>(buf), len);
+    dst.port = get_port(&buf[len]);
+    break;
+  }
+  case 4: { // IP V6
+    co_await boost::asio::async_read(sock_, boost::asio::buffer(buf, 18),
+      token);
+    if (err) {
+      co_return err;
+    }
+    array<uint8_t, 16> addr;
+    memcpy(addr.data(), buf, 16);
+    dst.hostname = "";
+    dst.ip_address = boost::asio::ip::address_v6(addr);
+    dst.port = get_port(&buf[16]);
+    break;
+  }
+  default:
+    co_return protocol_violation();
+  }
+
+  co_return kNoError;
+}
+
+// ---
+
+void server_session_socks5_coro::write_connect_response(
+  const connect_response& conn_resp,
+  write_response_handler handler)
+{
+  spawn_handshake(sock_, write_response(conn_resp.major), handler);
+}
+
+awaitable<boost::system::error_code>
+server_session_socks5_coro::write_response(connect_response::major_code mc)
+{
+  uint8_t buf[10] = {
+    5,                      // VER = 5
+    major_code_to_rep(mc),  // REP
+    0,                      // RSV
+    1,                      // ATYP
+    0, 0, 0, 0,             // BND.ADDR
+    0, 0                    // BND.PORT
+  };
+
+  error_code err;
+  co_await boost::asio::async_write(sock_, boost::asio::buffer(buf),
+    redirect_error(use_awaitable, err));
+
+  co_return err;
+}
+
+uint8_t server_session_socks5_coro::major_code_to_rep(
+  connect_response::major_code mc)
+{
+  switch (mc) {
+  case connect_response::eSucceeded: return 0;
+  case connect_response::eHostUnreachable: return 4;
+  case connect_response::eConnectionRefused: return 5;
+  case connect_response::eBadAddressType: return 8;
+  default:
+  case connect_response::eUnknownError: return 1;
+  }
+}
+
+}}
+
+#endif
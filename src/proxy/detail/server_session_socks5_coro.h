@@ -0,0 +1,40 @@
+#pragma once
+
+#include "proxy/server_session.h"
+
+#ifdef PROXY_HAVE_CORO_ENGINES
+
+#include <boost/asio/awaitable.hpp>
+
+#include <stdint.h>
+
+namespace proxy {
+namespace detail {
+
+// server_session_socks5 written as coroutines: each call runs as one
+// coroutine, the protocol state lives in its frame instead of members.
+class server_session_socks5_coro: public server_session {
+public:
+  server_session_socks5_coro(socket& sock);
+
+  // server interface
+
+  virtual void read_connect_request(
+    destination& dst,
+    read_request_handler handler) override;
+
+  virtual void write_connect_response(
+    const connect_response& conn_resp,
+    write_response_handler handler) override;
+
+private:
+  boost::asio::awaitable<error_code> read_request(destination& dst);
+  boost::asio::awaitable<error_code> write_response(
+    connect_response::major_code);
+
+  static uint8_t major_code_to_rep(connect_response::major_code);
+};
+
+}}
+
+#endif
@@ -21,6 +21,7 @@ string basic_error_category::message(int ev) const {
   case creds_too_long:          return "An element of credentials is too long";
   case hostname_too_long:       return "Hostname is too long";
   case line_too_long:           return "Line is too long";
+  case internal_error:          return "Internal error";
 
   default: return string(name()) + " error"; // "proxy.basic error"
   }
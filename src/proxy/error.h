@@ -24,7 +24,8 @@ enum basic_errors {
   bad_auth_method               = 4,
   creds_too_long                = 5,
   hostname_too_long             = 6,
-  line_too_long                 = 7
+  line_too_long                 = 7,
+  internal_error                = 8
 };
 
 inline boost::system::error_code make_error_code(basic_errors e) {
@@ -0,0 +1,13 @@
+#include "proxy/handshake_engine.h"
+
+namespace proxy {
+
+bool have_coroutine_engine() {
+#ifdef PROXY_HAVE_CORO_ENGINES
+  return true;
+#else
+  return false;
+#endif
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace proxy {
+
+// How the protocol sessions are written. Both behave the same on the
+// wire and report the same errors.
+enum handshake_engine {
+  eCallbackEngine,   //< chains of completion handlers
+  eCoroutineEngine   //< one C++20 coroutine per call
+};
+
+// The coroutine engines are built only with PROXY_HAVE_CORO_ENGINES
+// (C++20). Without them the factories fall back to eCallbackEngine.
+bool have_coroutine_engine();
+
+}
@@ -3,6 +3,8 @@
 
 #include "proxy/detail/server_session_socks5.h"
 #include "proxy/detail/server_session_https.h"
+#include "proxy/detail/server_session_socks5_coro.h"
+#include "proxy/detail/server_session_https_coro.h"
 
 #include <assert.h>
 
@@ -12,15 +14,32 @@ namespace proxy {
 
 server_session* create_server_session(
   boost::asio::ip::tcp::socket& sock, server_session::proxy_type type,
-  const string& dbglog_uid)
+  const string& dbglog_uid, handshake_engine engine, session_arena* arena)
 {
+#ifndef PROXY_HAVE_CORO_ENGINES
+  (void)engine;
+#endif
   server_session* ret = nullptr;
   switch (type) {
   case server_session::eSocks5:
-    ret = new detail::server_session_socks5(sock);
+#ifdef PROXY_HAVE_CORO_ENGINES
+    if (engine == eCoroutineEngine) {
+      ret = session_arena::create<detail::server_session_socks5_coro>(arena,
+        sock);
+      break;
+    }
+#endif
+    ret = session_arena::create<detail::server_session_socks5>(arena, sock);
     break;
   case server_session::eHttps:
-    ret = new detail::server_session_https(sock);
+#ifdef PROXY_HAVE_CORO_ENGINES
+    if (engine == eCoroutineEngine) {
+      ret = session_arena::create<detail::server_session_https_coro>(arena,
+        sock);
+      break;
+    }
+#endif
+    ret = session_arena::create<detail::server_session_https>(arena, sock);
     break;
   default:
     assert(0);
@@ -3,6 +3,8 @@
 
 #include "proxy/destination.h"
 #include "proxy/connect_response.h"
+#include "proxy/handshake_engine.h"
+#include "proxy/session_arena.h"
 
 #include <boost/asio.hpp>
 
@@ -27,6 +29,8 @@ public:
 
   // ---
 
+  virtual ~server_session() {}
+
   virtual void read_connect_request(
     destination& dst,
     read_request_handler handler) = 0;
@@ -35,19 +39,28 @@ public:
     const connect_response& conn_resp,
     write_response_handler handler) = 0;
 
+  // Bytes the client has sent after the connect request and the parser
+  // has read ahead. They belong to the tunnel.
+  std::string& unread_data() { return unread_; }
+
 protected:
   server_session(socket& sock): sock_(sock) {}
 
 protected:
   socket& sock_;
+  std::string unread_;
 
 public:
   std::string dbglog_uid_; //< Used to track messages in debug log.
 };
 
+// With |arena|, the session is created in it and must be released with
+// session_arena::destroy().
 server_session* create_server_session(
   boost::asio::ip::tcp::socket& sock, server_session::proxy_type type,
-  const std::string& dbglog_uid);
+  const std::string& dbglog_uid,
+  handshake_engine engine = eCallbackEngine,
+  session_arena* arena = nullptr);
 
 void enum_server_session_types(
   std::map<server_session::proxy_type, std::wstring>& type_name_map);
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <new>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace proxy {
+
+// Bump allocator over memory owned by the caller, for the objects of one
+// connection. They live and die together, so memory is never given back to
+// the arena, only reclaimed with it. Once it runs out, allocations go to the
+// heap.
+class session_arena {
+public:
+  session_arena(void* mem, size_t size)
+    :
+    begin_(static_cast<char*>(mem)),
+    cur_(begin_),
+    end_(begin_ + size)
+  {
+  }
+
+  void* allocate(size_t size, size_t align) {
+    const uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) &
+      ~static_cast<uintptr_t>(align - 1);
+    if (p + size <= reinterpret_cast<uintptr_t>(end_)) {
+      cur_ = reinterpret_cast<char*>(p + size);
+      return reinterpret_cast<void*>(p);
+    }
+    return ::operator new(size);
+  }
+
+  void deallocate(void* p) {
+    if (!owns(p)) {
+      ::operator delete(p);
+    }
+  }
+
+  bool owns(const void* p) const {
+    return p >= begin_ && p < end_;
+  }
+
+  size_t used() const { return cur_ - begin_; }
+
+  // A T in |arena|, on the heap if |arena| is null. Release it with
+  // destroy(), or with delete if |arena| was null.
+  template <typename T, typename... Args>
+  static T* create(session_arena* arena, Args&&... args) {
+    if (!arena) {
+      return new T(std::forward<Args>(args)...);
+    }
+    return new (arena->allocate(sizeof(T), alignof(T)))
+      T(std::forward<Args>(args)...);
+  }
+
+  template <typename T>
+  static void destroy(session_arena* arena, T* p) {
+    if (!arena) {
+      delete p;
+      return;
+    }
+    if (p) {
+      p->~T();
+      arena->deallocate(p);
+    }
+  }
+
+  // For std::unique_ptr.
+  template <typename T>
+  class deleter {
+  public:
+    explicit deleter(session_arena* arena = nullptr): arena_(arena) {}
+
+    void operator()(T* p) const { destroy(arena_, p); }
+
+  private:
+    session_arena*  arena_;
+  };
+
+  // For containers.
+  template <typename T>
+  class allocator {
+  public:
+    typedef T value_type;
+
+    explicit allocator(session_arena* arena = nullptr): arena_(arena) {}
+
+    template <typename U>
+    allocator(const allocator<U>& other) noexcept: arena_(other.arena_) {}
+
+    bool operator==(const allocator& other) const noexcept {
+      return arena_ == other.arena_;
+    }
+
+    bool operator!=(const allocator& other) const noexcept {
+      return arena_ != other.arena_;
+    }
+
+    T* allocate(size_t n) const {
+      if (!arena_) {
+        return static_cast<T*>(::operator new(sizeof(T) * n));
+      }
+      return static_cast<T*>(arena_->allocate(sizeof(T) * n, alignof(T)));
+    }
+
+    void deallocate(T* p, size_t) const {
+      if (!arena_) {
+        ::operator delete(p);
+      }
+      else {
+        arena_->deallocate(p);
+      }
+    }
+
+  private:
+    template <typename> friend class allocator;
+
+    session_arena*  arena_;
+  };
+
+private:
+  session_arena(const session_arena&) = delete;
+  session_arena& operator=(const session_arena&) = delete;
+
+private:
+  char*  begin_;
+  char*  cur_;
+  char*  end_;
+};
+
+}
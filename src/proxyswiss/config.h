@@ -19,6 +19,45 @@ struct config {
     eProxyServer
   };
 
+  enum relay_mode {
+    eRelayCopy,       //< read into user space buffer, write it out
+    eRelaySplice,     //< splice(2) through a pipe, Linux only
+    eRelayPipelined,  //< keep reading while writes are in flight
+    eRelayParked      //< copy, no buffer held while waiting for data
+  };
+
+  // Socket options for a listener and the sockets accepted on it, or for
+  // the outbound socket. Zeros leave the OS defaults. Options the
+  // platform doesn't have are skipped.
+  struct socket_profile {
+    enum nodelay_mode {
+      eNodelayDefault,
+      eNodelayHandshake,  //< TCP_NODELAY until the tunnel is up
+      eNodelayAlways
+    };
+
+    std::wstring  name;
+    nodelay_mode  nodelay;
+    unsigned      rcvbuf;              //< SO_RCVBUF, bytes
+    unsigned      sndbuf;              //< SO_SNDBUF, bytes
+    unsigned      notsent_lowat;       //< TCP_NOTSENT_LOWAT, bytes
+    bool          quickack;            //< TCP_QUICKACK
+    unsigned      keepalive_idle;      //< seconds, 0 = no SO_KEEPALIVE
+    unsigned      keepalive_interval;  //< seconds
+    unsigned      keepalive_count;
+    unsigned      defer_accept;        //< TCP_DEFER_ACCEPT, seconds
+    // TCP Fast Open, 0 = off. The TCP_FASTOPEN queue length on a
+    // listener, outbound sockets get TCP_FASTOPEN_CONNECT.
+    unsigned      fastopen;
+
+    socket_profile(): name(L"default"), nodelay(eNodelayDefault),
+      rcvbuf(0), sndbuf(0), notsent_lowat(0), quickack(false),
+      keepalive_idle(0), keepalive_interval(0), keepalive_count(0),
+      defer_accept(0), fastopen(0)
+    {
+    }
+  };
+
   struct input_t {
     input_type   type;
     endpoint     listen_addr;
@@ -32,22 +71,108 @@ struct config {
     struct {
       proxy::server_session::proxy_type proxy_server_type;
     } as_proxy_server;
+
+    proxy::handshake_engine engine;
+    // Seconds for the client to send its connect request, 0 = no limit.
+    unsigned                handshake_timeout;
+    socket_profile          sock_profile;
+
+    input_t(): engine(proxy::eCallbackEngine), handshake_timeout(30)
+    {
+    }
   };
 
   struct proxy_client_info {
     proxy::client_session::proxy_type  proxy_client_type;
     proxy::destination                 proxy_address;
     proxy::credentials                 proxy_creds;
+    // Send greeting, credentials and request in one write.
+    bool                               optimistic;
+
+    proxy_client_info(): optimistic(false)
+    {
+    }
   };
 
   struct output_t {
     std::vector<proxy_client_info>  proxy_chain; // Can be empty
+    // Connections to proxy_chain[0] kept ready per worker, 0 = off.
+    size_t                          hop_pool_size;
+    // Milliseconds before trying the next address of a name that
+    // resolved to several.
+    unsigned                        connect_attempt_delay;
+    // Seconds for the TCP connect to the first hop, 0 = OS default.
+    unsigned                        connect_timeout;
+    // Seconds for each hop to be connected through, TCP connect and
+    // proxy handshake together, 0 = no limit.
+    unsigned                        hop_timeout;
+    proxy::handshake_engine         engine;
+    // For the socket to proxy_chain[0], or to the destination if the
+    // chain is empty. The later hops are reached through it.
+    socket_profile                  sock_profile;
+
+    output_t(): hop_pool_size(0), connect_attempt_delay(250),
+      connect_timeout(10), hop_timeout(30), engine(proxy::eCallbackEngine)
+    {
+    }
+  };
+
+  struct server_t {
+    // Number of worker threads, each one running its own io_context.
+    // 1 means everything runs on the caller's io_context.
+    unsigned  num_threads;
+    // If not 0, per-thread session counts and buffer pool stats are
+    // printed every N seconds.
+    unsigned  thread_stats_interval;
+    // If not 0, metrics are served on 127.0.0.1:admin_port.
+    unsigned  admin_port;
+    // Accepts kept outstanding on each acceptor, so a burst of
+    // connections doesn't wait for one accept to complete per turn.
+    unsigned  pending_accepts;
+
+    server_t(): num_threads(1), thread_stats_interval(0), admin_port(0),
+      pending_accepts(4)
+    {
+    }
+  };
+
+  struct relay_t {
+    // Falls back to eRelayCopy where the mode isn't available.
+    relay_mode  mode;
+    // The most |max_in_flight| can be, what pipelined_relay's ring holds.
+    static const size_t kMaxInFlight = 128 * 1024;
+
+    // eRelayPipelined: max bytes read but not yet written, per direction.
+    size_t      max_in_flight;
+    // Seconds a tunnel may go without relaying a byte either way before
+    // it is closed, 0 = no limit.
+    unsigned    idle_timeout;
+
+    relay_t(): mode(eRelayCopy), max_in_flight(kMaxInFlight),
+      idle_timeout(0)
+    {
+    }
+  };
+
+  struct dns_t {
+    unsigned  ttl;           //< seconds to cache resolved names
+    unsigned  negative_ttl;  //< seconds to cache failures
+    size_t    max_entries;
+
+    dns_t(): ttl(60), negative_ttl(5), max_entries(10000)
+    {
+    }
   };
 
   // ---
 
   input_t   input;
   output_t  output;
+  // Defined with --sock-profile, besides the built-in ones.
+  std::vector<socket_profile>  socket_profiles;
+  server_t  server;
+  relay_t   relay;
+  dns_t     dns;
 };
 
 }
\ No newline at end of file
@@ -140,12 +140,358 @@ static bool proxy_info_from_string(const wstring& str,
   return true;
 }
 
+// --name=value
+static bool split_option(const wstring& str, wstring& name,
+  wstring& value)
+{
+  if (str.length() < 3 || str[0] != L'-' || str[1] != L'-') {
+    return false;
+  }
+  size_t eq = str.find(L'=');
+  if (eq == wstring::npos) {
+    name = str.substr(2);
+    value = L"";
+  }
+  else {
+    name = str.substr(2, eq - 2);
+    value = str.substr(eq + 1);
+  }
+  return true;
+}
+
+static bool uint_option(const wstring& name, const wstring& value,
+  unsigned min_val, unsigned& val, wstring& err_msg)
+{
+  if (value.empty() || !common::str_to_uint(value, val) || val < min_val) {
+    err_msg = str_printf(L"Bad value for --%s (%s)", name.c_str(),
+      value.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Built in, --sock-profile can't redefine them.
+static bool builtin_socket_profile(const wstring& name,
+  proxyswiss::config::socket_profile& prof)
+{
+  typedef proxyswiss::config::socket_profile socket_profile;
+
+  prof = socket_profile();
+  prof.name = name;
+  if (name == L"default") {
+    return true;
+  }
+  if (name == L"latency") {
+    prof.nodelay = socket_profile::eNodelayAlways;
+    prof.notsent_lowat = 16384;
+    prof.quickack = true;
+    return true;
+  }
+  if (name == L"bulk") {
+    prof.nodelay = socket_profile::eNodelayHandshake;
+    prof.rcvbuf = 1048576;
+    prof.sndbuf = 1048576;
+    return true;
+  }
+  return false;
+}
+
+static bool find_socket_profile(const proxyswiss::config& cfg,
+  const wstring& name, proxyswiss::config::socket_profile& prof)
+{
+  if (builtin_socket_profile(name, prof)) {
+    return true;
+  }
+  for (size_t i = 0; i < cfg.socket_profiles.size(); i++) {
+    if (cfg.socket_profiles[i].name == name) {
+      prof = cfg.socket_profiles[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+// NAME:setting,setting,...
+static bool socket_profile_from_string(const wstring& str,
+  const proxyswiss::config& cfg, proxyswiss::config::socket_profile& prof,
+  wstring& err_msg)
+{
+  typedef proxyswiss::config::socket_profile socket_profile;
+
+  const size_t colon = str.find(L':');
+  if (colon == 0 || colon == wstring::npos) {
+    err_msg = str_printf(L"Bad value for --sock-profile (%s)", str.c_str());
+    return false;
+  }
+  prof = socket_profile();
+  prof.name = str.substr(0, colon);
+  socket_profile existing;
+  if (find_socket_profile(cfg, prof.name, existing)) {
+    err_msg = str_printf(L"Socket profile %s already defined",
+      prof.name.c_str());
+    return false;
+  }
+
+  vector<wstring> settings;
+  common::str_split(str.substr(colon + 1), L",", settings);
+  for (size_t i = 0; i < settings.size(); i++) {
+    wstring name, value;
+    const size_t eq = settings[i].find(L'=');
+    name = settings[i].substr(0, eq);
+    if (eq != wstring::npos) {
+      value = settings[i].substr(eq + 1);
+    }
+
+    bool ok;
+    if (name == L"nodelay") {
+      ok = value.empty() || value == L"handshake";
+      prof.nodelay = value.empty() ?
+        socket_profile::eNodelayAlways : socket_profile::eNodelayHandshake;
+    }
+    else if (name == L"quickack") {
+      ok = value.empty();
+      prof.quickack = true;
+    }
+    else if (name == L"rcvbuf") {
+      ok = common::str_to_uint(value, prof.rcvbuf) && prof.rcvbuf;
+    }
+    else if (name == L"sndbuf") {
+      ok = common::str_to_uint(value, prof.sndbuf) && prof.sndbuf;
+    }
+    else if (name == L"notsent-lowat") {
+      ok = common::str_to_uint(value, prof.notsent_lowat) &&
+        prof.notsent_lowat;
+    }
+    else if (name == L"fastopen") {
+      // The queue length only matters on a listener.
+      static const unsigned kDefaultFastopenQueue = 256;
+      prof.fastopen = kDefaultFastopenQueue;
+      ok = value.empty() ||
+        (common::str_to_uint(value, prof.fastopen) && prof.fastopen);
+    }
+    else if (name == L"defer-accept") {
+      ok = common::str_to_uint(value, prof.defer_accept) &&
+        prof.defer_accept;
+    }
+    else if (name == L"keepalive") {
+      // IDLE/INTERVAL/COUNT
+      vector<wstring> parts;
+      common::str_split(value, L"/", parts);
+      ok = parts.size() == 3 &&
+        common::str_to_uint(parts[0], prof.keepalive_idle) &&
+        common::str_to_uint(parts[1], prof.keepalive_interval) &&
+        common::str_to_uint(parts[2], prof.keepalive_count) &&
+        prof.keepalive_idle && prof.keepalive_interval &&
+        prof.keepalive_count;
+    }
+    else {
+      err_msg = str_printf(L"Unknown socket setting %s in --sock-profile",
+        name.c_str());
+      return false;
+    }
+    if (!ok) {
+      err_msg = str_printf(L"Bad socket setting %s in --sock-profile",
+        settings[i].c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool socket_profile_option(const wstring& name, const wstring& value,
+  const proxyswiss::config& cfg, proxyswiss::config::socket_profile& prof,
+  wstring& err_msg)
+{
+  if (!find_socket_profile(cfg, value, prof)) {
+    err_msg = str_printf(L"Unknown socket profile for --%s (%s)",
+      name.c_str(), value.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Options preceding <inType>.
+static bool server_option_from_string(const wstring& str,
+  proxyswiss::config& cfg, wstring& err_msg)
+{
+  wstring name, value;
+  if (!split_option(str, name, value)) {
+    err_msg = L"Bad option format";
+    return false;
+  }
+  if (name == L"threads") {
+    return uint_option(name, value, 1, cfg.server.num_threads, err_msg);
+  }
+  if (name == L"thread-stats") {
+    return uint_option(name, value, 0, cfg.server.thread_stats_interval,
+      err_msg);
+  }
+  if (name == L"admin-port") {
+    if (!uint_option(name, value, 0, cfg.server.admin_port, err_msg)) {
+      return false;
+    }
+    if (cfg.server.admin_port > 65535) {
+      err_msg = str_printf(L"Bad value for --%s (%s)", name.c_str(),
+        value.c_str());
+      return false;
+    }
+    return true;
+  }
+  if (name == L"pending-accepts") {
+    return uint_option(name, value, 1, cfg.server.pending_accepts, err_msg);
+  }
+  if (name == L"connect-delay") {
+    return uint_option(name, value, 1, cfg.output.connect_attempt_delay,
+      err_msg);
+  }
+  if (name == L"connect-timeout") {
+    return uint_option(name, value, 0, cfg.output.connect_timeout, err_msg);
+  }
+  if (name == L"handshake-timeout") {
+    return uint_option(name, value, 0, cfg.input.handshake_timeout,
+      err_msg);
+  }
+  if (name == L"hop-timeout") {
+    return uint_option(name, value, 0, cfg.output.hop_timeout, err_msg);
+  }
+  if (name == L"idle-timeout") {
+    return uint_option(name, value, 0, cfg.relay.idle_timeout, err_msg);
+  }
+  if (name == L"dns-ttl") {
+    return uint_option(name, value, 0, cfg.dns.ttl, err_msg);
+  }
+  if (name == L"dns-negative-ttl") {
+    return uint_option(name, value, 0, cfg.dns.negative_ttl, err_msg);
+  }
+  if (name == L"hop-pool") {
+    unsigned size;
+    if (!uint_option(name, value, 0, size, err_msg)) {
+      return false;
+    }
+    cfg.output.hop_pool_size = size;
+    return true;
+  }
+  if (name == L"relay") {
+    if (value == L"copy") {
+      cfg.relay.mode = proxyswiss::config::eRelayCopy;
+      return true;
+    }
+    if (value == L"splice") {
+      cfg.relay.mode = proxyswiss::config::eRelaySplice;
+      return true;
+    }
+    if (value == L"pipelined") {
+      cfg.relay.mode = proxyswiss::config::eRelayPipelined;
+      return true;
+    }
+    if (value == L"parked") {
+      cfg.relay.mode = proxyswiss::config::eRelayParked;
+      return true;
+    }
+    err_msg = str_printf(L"Bad value for --relay (%s)", value.c_str());
+    return false;
+  }
+  if (name == L"engine") {
+    proxy::handshake_engine engine;
+    if (value == L"callback") {
+      engine = proxy::eCallbackEngine;
+    }
+    else if (value == L"coro") {
+      if (!proxy::have_coroutine_engine()) {
+        err_msg = L"--engine=coro: built without the coroutine engines";
+        return false;
+      }
+      engine = proxy::eCoroutineEngine;
+    }
+    else {
+      err_msg = str_printf(L"Bad value for --engine (%s)", value.c_str());
+      return false;
+    }
+    cfg.input.engine = engine;
+    cfg.output.engine = engine;
+    return true;
+  }
+  if (name == L"sock-profile") {
+    proxyswiss::config::socket_profile prof;
+    if (!socket_profile_from_string(value, cfg, prof, err_msg)) {
+      return false;
+    }
+    cfg.socket_profiles.push_back(prof);
+    return true;
+  }
+  if (name == L"in-sock") {
+    return socket_profile_option(name, value, cfg, cfg.input.sock_profile,
+      err_msg);
+  }
+  if (name == L"out-sock") {
+    return socket_profile_option(name, value, cfg, cfg.output.sock_profile,
+      err_msg);
+  }
+  if (name == L"max-in-flight") {
+    unsigned kib;
+    if (!uint_option(name, value, 1, kib, err_msg)) {
+      return false;
+    }
+    if (kib > proxyswiss::config::relay_t::kMaxInFlight / 1024) {
+      err_msg = str_printf(L"Bad value for --%s (%s), at most %u",
+        name.c_str(), value.c_str(),
+        static_cast<unsigned>(proxyswiss::config::relay_t::kMaxInFlight /
+          1024));
+      return false;
+    }
+    cfg.relay.max_in_flight = static_cast<size_t>(kib) * 1024;
+    return true;
+  }
+  err_msg = str_printf(L"Unknown option --%s", name.c_str());
+  return false;
+}
+
+// Options following a proxy-chain entry, they apply to that entry.
+static bool hop_option_from_string(const wstring& str,
+  proxyswiss::config& cfg, wstring& err_msg)
+{
+  proxyswiss::config::proxy_client_info& hop(cfg.output.proxy_chain.back());
+  wstring name, value;
+  if (!split_option(str, name, value)) {
+    err_msg = L"Bad option format";
+    return false;
+  }
+  if (name == L"optimistic") {
+    if (!value.empty()) {
+      err_msg = str_printf(L"Bad value for --%s (%s)", name.c_str(),
+        value.c_str());
+      return false;
+    }
+    hop.optimistic = true;
+    return true;
+  }
+  if (name == L"sock") {
+    // Later hops are reached through the first one's connection.
+    if (cfg.output.proxy_chain.size() != 1) {
+      err_msg = L"--sock: only the first hop has a socket of its own";
+      return false;
+    }
+    return socket_profile_option(name, value, cfg, cfg.output.sock_profile,
+      err_msg);
+  }
+  err_msg = str_printf(L"Unknown hop option --%s", name.c_str());
+  return false;
+}
+
 int config_from_cmdline(
   int                  fc,
   wchar_t*             fv[],
   proxyswiss::config&  cfg,
   std::wstring&        err_msg)
 {
+  while (fc > 0 && fv[0][0] == L'-') {
+    if (!server_option_from_string(fv[0], cfg, err_msg)) {
+      return 1;
+    }
+    fc--;
+    fv++;
+  }
+
   if (fc < 2) {
     return 1;
   }
@@ -215,6 +561,20 @@ int config_from_cmdline(
   }
 
   for (int i = fchain; i < fc; i++) {
+    if (fv[i][0] == L'-') {
+      if (cfg.output.proxy_chain.empty()) {
+        err_msg = str_printf(L"Hop option %s before proxy-chain", fv[i]);
+        return -1;
+      }
+      if (!hop_option_from_string(fv[i], cfg, sub_err_msg))
+      {
+        err_msg = str_printf(L"proxy-chain[%d]: %s",
+          static_cast<int>(cfg.output.proxy_chain.size() - 1),
+          sub_err_msg.c_str());
+        return -1;
+      }
+      continue;
+    }
     if (!proxy_info_from_string(fv[i], host, &proxy_type_str, &creds,
       sub_err_msg))
     {
@@ -0,0 +1,125 @@
+#include "proxyswiss/detail/admin_server.h"
+
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind/bind.hpp>
+
+#define dbgprint(...) __noop
+
+using namespace std;
+using namespace boost::placeholders;
+
+namespace proxyswiss {
+namespace detail {
+
+// Requests are tiny, anything bigger is not a scraper.
+static const size_t kMaxRequestSize = 8192;
+
+namespace {
+
+struct admin_connection {
+  typedef boost::system::error_code error_code;
+
+  boost::asio::ip::tcp::socket  sock;
+  boost::asio::streambuf        request;
+  string                        response;
+
+  admin_connection(boost::asio::ip::tcp::socket&& s)
+    : sock(std::move(s)), request(kMaxRequestSize)
+  {
+  }
+};
+
+typedef shared_ptr<admin_connection> admin_connection_ptr;
+
+void handle_write_response(admin_connection_ptr conn,
+  boost::system::error_code, size_t)
+{
+  boost::system::error_code ec;
+  conn->sock.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+  conn->sock.close(ec);
+}
+
+void handle_read_request(admin_connection_ptr conn,
+  const admin_server::body_maker& make_body, boost::system::error_code err,
+  size_t)
+{
+  if (err) {
+    dbgprint("error %s.%d\n", err.category().name(), err.value());
+
+    boost::system::error_code ec;
+    conn->sock.close(ec);
+    return;
+  }
+
+  const string body(make_body());
+
+  conn->response =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/plain; version=0.0.4\r\n"
+    "Content-Length: " + to_string(body.size()) + "\r\n"
+    "Connection: close\r\n"
+    "\r\n" + body;
+
+  boost::asio::async_write(conn->sock, boost::asio::buffer(conn->response),
+    boost::bind(&handle_write_response, conn, _1, _2));
+}
+
+}
+
+admin_server::admin_server(io_context& ioc, body_maker make_body)
+  : ioc_(ioc), make_body_(make_body), acpt_(ioc)
+{
+}
+
+bool admin_server::open(const endpoint& ep, error_code& err) {
+  acpt_.open(ep.protocol(), err);
+  if (!err) {
+    acpt_.set_option(acceptor::reuse_address(true), err);
+  }
+  if (!err) {
+    acpt_.bind(ep, err);
+  }
+  if (!err) {
+    acpt_.listen(boost::asio::socket_base::max_listen_connections, err);
+  }
+  if (err) {
+    dbgprint("can't open admin endpoint, error %s.%d (%s)\n",
+      err.category().name(), err.value(), err.message().c_str());
+
+    error_code ec;
+    acpt_.close(ec);
+    return false;
+  }
+  return true;
+}
+
+void admin_server::start() {
+  do_accept();
+}
+
+void admin_server::stop() {
+  error_code ec;
+  acpt_.close(ec);
+}
+
+void admin_server::do_accept() {
+  shared_ptr<socket> sock(new socket(ioc_));
+  acpt_.async_accept(*sock,
+    boost::bind(&admin_server::handle_accept, this, sock, _1));
+}
+
+void admin_server::handle_accept(shared_ptr<socket> sock, error_code err) {
+  if (err == boost::asio::error::operation_aborted) {
+    return;
+  }
+  if (!err) {
+    admin_connection_ptr conn(new admin_connection(std::move(*sock)));
+    boost::asio::async_read_until(conn->sock, conn->request, "\r\n\r\n",
+      boost::bind(&handle_read_request, conn, make_body_, _1, _2));
+  }
+  do_accept();
+}
+
+}}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace proxyswiss {
+namespace detail {
+
+// Minimal HTTP/1.0 endpoint for the metrics. Whatever the request is,
+// the answer is the text made by |make_body|, in the Prometheus text
+// format, and the connection is closed.
+class admin_server {
+public:
+  typedef boost::asio::io_context io_context;
+  typedef boost::asio::ip::tcp::endpoint endpoint;
+  typedef boost::asio::ip::tcp::acceptor acceptor;
+  typedef boost::asio::ip::tcp::socket socket;
+  typedef boost::system::error_code error_code;
+  typedef std::function<std::string()> body_maker;
+
+  admin_server(io_context& ioc, body_maker make_body);
+
+  bool open(const endpoint& ep, error_code& err);
+  void start();
+  void stop();
+
+private:
+  void do_accept();
+  void handle_accept(std::shared_ptr<socket>, error_code);
+
+private:
+  io_context&  ioc_;
+  body_maker   make_body_;
+  acceptor     acpt_;
+};
+
+}}
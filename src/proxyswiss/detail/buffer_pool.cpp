@@ -0,0 +1,124 @@
+#include "proxyswiss/detail/buffer_pool.h"
+
+#include <assert.h>
+
+using namespace std;
+
+namespace proxyswiss {
+namespace detail {
+
+// Single writer, no need for a locked read-modify-write.
+static inline void add_relaxed(atomic<uint64_t>& a, uint64_t v) {
+  a.store(a.load(memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+static inline void sub_relaxed(atomic<uint64_t>& a, uint64_t v) {
+  a.store(a.load(memory_order_relaxed) - v, memory_order_relaxed);
+}
+
+buffer_pool::buffer::buffer(buffer&& other)
+  : pool_(other.pool_), data_(other.data_), size_class_(other.size_class_)
+{
+  other.pool_ = nullptr;
+  other.data_ = nullptr;
+}
+
+buffer_pool::buffer& buffer_pool::buffer::operator=(buffer&& other) {
+  if (this != &other) {
+    reset();
+    pool_ = other.pool_;
+    data_ = other.data_;
+    size_class_ = other.size_class_;
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+  }
+  return *this;
+}
+
+void buffer_pool::buffer::reset() {
+  if (data_) {
+    pool_->give_back(data_, size_class_);
+    pool_ = nullptr;
+    data_ = nullptr;
+  }
+}
+
+// ---
+
+buffer_pool::buffer_pool(size_t max_cached_bytes)
+  : max_cached_bytes_(max_cached_bytes), hits_(0), misses_(0),
+    bytes_in_use_(0), bytes_cached_(0)
+{
+}
+
+buffer_pool::~buffer_pool() {
+  assert(bytes_in_use_ == 0);
+
+  for (unsigned i = 0; i < kNumClasses; i++) {
+    for (size_t j = 0; j < free_lists_[i].size(); j++) {
+      delete[] free_lists_[i][j];
+    }
+  }
+}
+
+buffer_pool::buffer buffer_pool::acquire(unsigned size_class) {
+  assert(size_class < kNumClasses);
+
+  const size_t size = class_size(size_class);
+  char* data;
+
+  vector<char*>& fl(free_lists_[size_class]);
+  if (!fl.empty()) {
+    data = fl.back();
+    fl.pop_back();
+    sub_relaxed(bytes_cached_, size);
+    add_relaxed(hits_, 1);
+  }
+  else {
+    data = new char[size];
+    add_relaxed(misses_, 1);
+  }
+
+  add_relaxed(bytes_in_use_, size);
+  return buffer(this, data, size_class);
+}
+
+void buffer_pool::give_back(char* data, unsigned size_class) {
+  const size_t size = class_size(size_class);
+
+  sub_relaxed(bytes_in_use_, size);
+
+  if (bytes_cached_.load(memory_order_relaxed) + size > max_cached_bytes_) {
+    delete[] data;
+    return;
+  }
+
+  free_lists_[size_class].push_back(data);
+  add_relaxed(bytes_cached_, size);
+}
+
+void buffer_pool::get_stats(stats& st) const {
+  st.hits = hits_.load(memory_order_relaxed);
+  st.misses = misses_.load(memory_order_relaxed);
+  st.bytes_in_use = bytes_in_use_.load(memory_order_relaxed);
+  st.bytes_cached = bytes_cached_.load(memory_order_relaxed);
+}
+
+// ---
+
+buffer_pool::stats& buffer_pool::stats::operator+=(const stats& other) {
+  hits += other.hits;
+  misses += other.misses;
+  bytes_in_use += other.bytes_in_use;
+  bytes_cached += other.bytes_cached;
+  return *this;
+}
+
+double buffer_pool::stats::hit_rate() const {
+  if (hits + misses == 0) {
+    return 0;
+  }
+  return 100.0 * hits / (hits + misses);
+}
+
+}}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace proxyswiss {
+namespace detail {
+
+// Size-classed cache of relay buffers. Not thread safe, every worker has
+// its own pool. get_stats() is the only member that can be called from
+// other threads.
+class buffer_pool {
+public:
+  static const unsigned kNumClasses = 6; // 4K, 8K, ... 128K
+  static const size_t kDefaultMaxCachedBytes = 16 * 1024 * 1024;
+
+  class buffer {
+  public:
+    buffer(): pool_(nullptr), data_(nullptr), size_class_(0) {}
+    buffer(buffer&& other);
+    buffer& operator=(buffer&& other);
+    ~buffer() { reset(); }
+
+    char*     data()       const { return data_; }
+    size_t    size()       const { return class_size(size_class_); }
+    unsigned  size_class() const { return size_class_; }
+    bool      empty()      const { return data_ == nullptr; }
+
+    // Returns memory to the pool.
+    void reset();
+
+  private:
+    friend class buffer_pool;
+    buffer(buffer_pool* pool, char* data, unsigned size_class)
+      : pool_(pool), data_(data), size_class_(size_class)
+    {
+    }
+    buffer(const buffer&) = delete;
+    buffer& operator=(const buffer&) = delete;
+
+    buffer_pool*  pool_;
+    char*         data_;
+    unsigned      size_class_;
+  };
+
+  struct stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t bytes_in_use;
+    uint64_t bytes_cached;
+
+    stats(): hits(0), misses(0), bytes_in_use(0), bytes_cached(0)
+    {
+    }
+
+    stats& operator+=(const stats& other);
+
+    // 0 .. 100
+    double hit_rate() const;
+  };
+
+  explicit buffer_pool(size_t max_cached_bytes = kDefaultMaxCachedBytes);
+  ~buffer_pool();
+
+  buffer acquire(unsigned size_class);
+
+  static constexpr size_t class_size(unsigned size_class) {
+    return static_cast<size_t>(4096) << size_class;
+  }
+
+  void get_stats(stats& st) const;
+
+private:
+  void give_back(char* data, unsigned size_class);
+
+  buffer_pool(const buffer_pool&) = delete;
+  buffer_pool& operator=(const buffer_pool&) = delete;
+
+private:
+  std::vector<char*>     free_lists_[kNumClasses];
+  size_t                 max_cached_bytes_;
+
+  // Written by the owning thread only.
+  std::atomic<uint64_t>  hits_;
+  std::atomic<uint64_t>  misses_;
+  std::atomic<uint64_t>  bytes_in_use_;
+  std::atomic<uint64_t>  bytes_cached_;
+};
+
+}}
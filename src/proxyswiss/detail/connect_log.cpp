@@ -0,0 +1,184 @@
+#include "proxyswiss/detail/connect_log.h"
+
+#include <chrono>
+#include <functional>
+
+using namespace std;
+
+namespace proxyswiss {
+namespace detail {
+
+// How long the writer sleeps when the ring is empty. Names wait at most
+// this long to be written.
+static const chrono::milliseconds kIdleWait(50);
+
+// A table slot is tried at most this many times from the one the hash
+// points to.
+static const size_t kMaxProbes = 16;
+
+static size_t round_up_pow2(size_t n) {
+  size_t ret = 1;
+  while (ret < n) {
+    ret <<= 1;
+  }
+  return ret;
+}
+
+// std::hash<string> may be weak in its low bits, which pick the slot.
+static uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+connect_log::connect_log(size_t ring_size, size_t table_size)
+  :
+  stopping_(false),
+  ring_mask_(round_up_pow2(ring_size) - 1),
+  enqueue_pos_(0),
+  dequeue_pos_(0),
+  table_mask_(round_up_pow2(table_size) - 1),
+  logged_(0), duplicates_(0), dropped_(0), untracked_(0)
+{
+  ring_.reset(new slot[ring_mask_ + 1]);
+  for (size_t i = 0; i <= ring_mask_; i++) {
+    ring_[i].seq.store(i, memory_order_relaxed);
+  }
+  table_.reset(new atomic<uint64_t>[table_mask_ + 1]);
+  for (size_t i = 0; i <= table_mask_; i++) {
+    table_[i].store(0, memory_order_relaxed);
+  }
+}
+
+connect_log::~connect_log() {
+  if (writer_.joinable()) {
+    stopping_.store(true, memory_order_release);
+    writer_.join();
+  }
+}
+
+bool connect_log::open(const wstring& filename) {
+  file_.open(filename, std::ios::out);
+  if (!file_.is_open()) {
+    return false;
+  }
+  writer_ = thread(&connect_log::writer_loop, this);
+  return true;
+}
+
+void connect_log::add(const string& id) {
+  atomic<uint64_t>* entry;
+  if (!remember(mix(std::hash<string>()(id)), entry)) {
+    duplicates_.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+  if (!push(id)) {
+    dropped_.fetch_add(1, memory_order_relaxed);
+    // Remembered but not logged would keep it out of the log for good.
+    // A name probing past the emptied slot in the meantime may be logged
+    // twice, that is all.
+    if (entry) {
+      entry->store(0, memory_order_relaxed);
+    }
+  }
+}
+
+void connect_log::get_stats(stats& st) const {
+  st.logged = logged_.load(memory_order_relaxed);
+  st.duplicates = duplicates_.load(memory_order_relaxed);
+  st.dropped = dropped_.load(memory_order_relaxed);
+  st.untracked = untracked_.load(memory_order_relaxed);
+}
+
+// False if |hash| was already there.
+bool connect_log::remember(uint64_t hash, atomic<uint64_t>*& entry_taken) {
+  entry_taken = nullptr;
+  if (hash == 0) {
+    hash = 1;
+  }
+  for (size_t i = 0; i < kMaxProbes; i++) {
+    atomic<uint64_t>& entry(table_[(hash + i) & table_mask_]);
+    uint64_t cur = entry.load(memory_order_relaxed);
+    if (cur == 0 &&
+        entry.compare_exchange_strong(cur, hash, memory_order_relaxed))
+    {
+      entry_taken = &entry;
+      return true;
+    }
+    // Either there before, or put there by someone else just now.
+    if (cur == hash) {
+      return false;
+    }
+  }
+  untracked_.fetch_add(1, memory_order_relaxed);
+  return true;
+}
+
+bool connect_log::push(const string& id) {
+  size_t pos = enqueue_pos_.load(memory_order_relaxed);
+  slot* s;
+  for (;;) {
+    s = &ring_[pos & ring_mask_];
+    const size_t seq = s->seq.load(memory_order_acquire);
+    const intptr_t diff =
+      static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+        memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (diff < 0) {
+      return false;
+    }
+    else {
+      pos = enqueue_pos_.load(memory_order_relaxed);
+    }
+  }
+  s->id.assign(id);
+  s->seq.store(pos + 1, memory_order_release);
+  return true;
+}
+
+bool connect_log::pop(string& id) {
+  slot& s(ring_[dequeue_pos_ & ring_mask_]);
+  if (s.seq.load(memory_order_acquire) != dequeue_pos_ + 1) {
+    return false;
+  }
+  // The slot keeps |id|'s old buffer for the next push.
+  id.swap(s.id);
+  s.seq.store(dequeue_pos_ + ring_mask_ + 1, memory_order_release);
+  dequeue_pos_++;
+  return true;
+}
+
+void connect_log::writer_loop() {
+  string id;
+  for (;;) {
+    // Checked before draining, so nothing added before stopping is lost.
+    const bool stopping = stopping_.load(memory_order_acquire);
+
+    // At most a ringful per flush, the workers may keep it from emptying.
+    size_t n = 0;
+    while (n <= ring_mask_ && pop(id)) {
+      file_ << id << '\n';
+      n++;
+    }
+    if (n) {
+      file_.flush();
+      logged_.fetch_add(n, memory_order_relaxed);
+    }
+    if (!n) {
+      if (stopping) {
+        break;
+      }
+      this_thread::sleep_for(kIdleWait);
+    }
+  }
+}
+
+}}
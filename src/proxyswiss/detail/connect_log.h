@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace proxyswiss {
+namespace detail {
+
+// Writes each destination connected to once, in the background. add() is
+// called by the workers and never blocks: names go through a lock-free ring
+// to a writer thread, which writes them out in batches, one flush per
+// batch. If the ring is full, the name is dropped and forgotten, so the
+// next connect to it logs it.
+//
+// Seen destinations are remembered by 64-bit hash in a fixed-size,
+// lock-free table. Once it's full, new destinations are still logged but
+// not remembered, so they can be logged again.
+class connect_log {
+public:
+  static const size_t kDefaultRingSize = 4096;
+  static const size_t kDefaultTableSize = 64 * 1024;
+
+  struct stats {
+    uint64_t  logged;
+    uint64_t  duplicates;
+    uint64_t  dropped;     //< the ring was full
+    uint64_t  untracked;   //< the table was full
+
+    stats(): logged(0), duplicates(0), dropped(0), untracked(0)
+    {
+    }
+  };
+
+  // Sizes are rounded up to powers of 2.
+  explicit connect_log(size_t ring_size = kDefaultRingSize,
+    size_t table_size = kDefaultTableSize);
+  // Writes what is left in the ring.
+  ~connect_log();
+
+  bool open(const std::wstring& filename);
+
+  // Can be called from any thread.
+  void add(const std::string& id);
+
+  void get_stats(stats& st) const;
+
+private:
+  // Bounded MPMC queue by Dmitry Vyukov, used with a single consumer.
+  struct slot {
+    std::atomic<size_t>  seq;
+    std::string          id;
+  };
+
+  // |entry| is the slot taken, null if the table is full.
+  bool remember(uint64_t hash, std::atomic<uint64_t>*& entry);
+  bool push(const std::string& id);
+  bool pop(std::string& id);
+  void writer_loop();
+
+  connect_log(const connect_log&) = delete;
+  connect_log& operator=(const connect_log&) = delete;
+
+private:
+  std::ofstream                          file_;
+  std::thread                            writer_;
+  std::atomic<bool>                      stopping_;
+
+  std::unique_ptr<slot[]>                ring_;
+  size_t                                 ring_mask_;
+  std::atomic<size_t>                    enqueue_pos_;
+  size_t                                 dequeue_pos_; //< writer only
+
+  // 0 is an empty slot.
+  std::unique_ptr<std::atomic<uint64_t>[]>  table_;
+  size_t                                    table_mask_;
+
+  std::atomic<uint64_t>                  logged_;
+  std::atomic<uint64_t>                  duplicates_;
+  std::atomic<uint64_t>                  dropped_;
+  std::atomic<uint64_t>                  untracked_;
+};
+
+}}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace proxyswiss {
+namespace detail {
+
+// A counter on its own cache line, so the worker writing it and a
+// thread collecting the metrics never share a line with anything else.
+// One writer only.
+struct alignas(64) padded_counter {
+  std::atomic<uint64_t>  value;
+
+  padded_counter(): value(0)
+  {
+  }
+
+  void add(uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n,
+      std::memory_order_relaxed);
+  }
+
+  uint64_t get() const {
+    return value.load(std::memory_order_relaxed);
+  }
+
+private:
+  padded_counter(const padded_counter&) = delete;
+  padded_counter& operator=(const padded_counter&) = delete;
+};
+
+// Per worker, written by the worker thread.
+struct worker_counters {
+  struct hop {
+    padded_counter  succeeded;
+    padded_counter  failed;
+  };
+
+  padded_counter          bytes_upstream;    //< client -> destination
+  padded_counter          bytes_downstream;  //< destination -> client
+  // Sessions closed by a deadline, by the stage they were stuck in.
+  padded_counter          handshake_timeouts;
+  padded_counter          hop_timeouts;
+  padded_counter          idle_timeouts;
+  // TCP Fast Open: connects to the first hop made with it and those the
+  // hop took the SYN data of, clients whose SYN data we took.
+  padded_counter          fastopen_out_tried;
+  padded_counter          fastopen_out_acked;
+  padded_counter          fastopen_in_acked;
+  // By output::connect_result::chain_fail_index, one per proxy_chain
+  // entry, or one for direct connects if there is no chain.
+  std::unique_ptr<hop[]>  hops;
+  size_t                  num_hops;
+
+  worker_counters(): num_hops(0)
+  {
+  }
+
+  void set_num_hops(size_t n) {
+    hops.reset(new hop[n]);
+    num_hops = n;
+  }
+};
+
+}}
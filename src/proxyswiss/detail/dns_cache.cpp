@@ -0,0 +1,167 @@
+#include "proxyswiss/detail/dns_cache.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <assert.h>
+
+#define dbgprint(...) __noop
+
+using namespace std;
+using namespace boost::placeholders;
+
+namespace proxyswiss {
+namespace detail {
+
+dns_cache::dns_cache(chrono::seconds ttl, chrono::seconds negative_ttl,
+  size_t max_entries)
+  :
+  ttl_(ttl), negative_ttl_(negative_ttl), max_entries_(max_entries),
+  next_ticket_(1), hits_(0), negative_hits_(0), misses_(0), coalesced_(0)
+{
+}
+
+uint64_t dns_cache::async_resolve(io_context& ioc, const string& hostname,
+  resolve_handler handler)
+{
+  const auto now = chrono::steady_clock::now();
+
+  unique_lock<mutex> lock(mutex_);
+
+  auto it = entries_.find(hostname);
+  if (it != entries_.end()) {
+    entry& e(it->second);
+
+    if (e.pending) {
+      const uint64_t ticket = next_ticket_++;
+      e.waiters.push_back(waiter{ticket, &ioc, handler});
+      ++coalesced_;
+      return ticket;
+    }
+
+    if (e.expires > now) {
+      error_code err(e.err);
+      address_list addrs(e.addrs);
+      lock.unlock();
+
+      if (err) {
+        ++negative_hits_;
+      }
+      else {
+        ++hits_;
+      }
+      boost::asio::post(ioc, boost::bind(handler, err, addrs));
+      return 0;
+    }
+  }
+  else {
+    make_room();
+    it = entries_.insert(make_pair(hostname, entry())).first;
+  }
+
+  entry& e(it->second);
+  e.pending = true;
+  const uint64_t ticket = next_ticket_++;
+  e.waiters.push_back(waiter{ticket, &ioc, handler});
+  lock.unlock();
+
+  ++misses_;
+
+  dbgprint("resolving %s\n", hostname.c_str());
+
+  shared_ptr<resolver> r(new resolver(ioc));
+  r->async_resolve(hostname, "",
+    boost::bind(&dns_cache::handle_resolve, shared_from_this(), r,
+      hostname, _1, _2));
+  return ticket;
+}
+
+bool dns_cache::cancel(const string& hostname, uint64_t ticket) {
+  lock_guard<mutex> lock(mutex_);
+
+  auto it = entries_.find(hostname);
+  if (it == entries_.end()) {
+    return false;
+  }
+
+  vector<waiter>& waiters(it->second.waiters);
+  for (size_t i = 0; i < waiters.size(); i++) {
+    if (waiters[i].ticket == ticket) {
+      waiters.erase(waiters.begin() + i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void dns_cache::handle_resolve(shared_ptr<resolver>, const string& hostname,
+  error_code err, resolver::results_type results)
+{
+  address_list addrs;
+  if (!err) {
+    for (auto it = results.begin(); it != results.end(); ++it) {
+      addrs.push_back(it->endpoint().address());
+    }
+    if (addrs.empty()) {
+      err = boost::asio::error::host_not_found;
+    }
+  }
+
+  vector<waiter> waiters;
+  {
+    lock_guard<mutex> lock(mutex_);
+
+    entry& e(entries_[hostname]);
+    e.pending = false;
+    e.err = err;
+    e.addrs = addrs;
+    e.expires = chrono::steady_clock::now() + (err ? negative_ttl_ : ttl_);
+    waiters.swap(e.waiters);
+  }
+
+  for (size_t i = 0; i < waiters.size(); i++) {
+    boost::asio::post(*waiters[i].pioc,
+      boost::bind(waiters[i].handler, err, addrs));
+  }
+}
+
+void dns_cache::make_room() {
+  // Called with |mutex_| locked.
+  if (entries_.size() < max_entries_) {
+    return;
+  }
+
+  const auto now = chrono::steady_clock::now();
+  for (auto it = entries_.begin(); it != entries_.end(); ) {
+    if (!it->second.pending && it->second.expires <= now) {
+      it = entries_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  // Still full, evict whatever isn't in flight.
+  for (auto it = entries_.begin();
+       it != entries_.end() && entries_.size() >= max_entries_; )
+  {
+    if (!it->second.pending) {
+      it = entries_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
+void dns_cache::get_stats(stats& st) const {
+  st.hits = hits_.load();
+  st.negative_hits = negative_hits_.load();
+  st.misses = misses_.load();
+  st.coalesced = coalesced_.load();
+
+  lock_guard<mutex> lock(mutex_);
+  st.entries = entries_.size();
+}
+
+}}
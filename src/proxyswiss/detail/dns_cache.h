@@ -0,0 +1,92 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace proxyswiss {
+namespace detail {
+
+// Process-wide cache of resolved host names, shared by all workers.
+// Failures are cached too (for a shorter time). Concurrent lookups of the
+// same name wait for the one query in flight.
+class dns_cache: public std::enable_shared_from_this<dns_cache> {
+public:
+  typedef boost::asio::io_context io_context;
+  typedef boost::system::error_code error_code;
+  typedef std::vector<boost::asio::ip::address> address_list;
+  typedef std::function<void(error_code, const address_list&)>
+    resolve_handler;
+
+  struct stats {
+    uint64_t  hits;
+    uint64_t  negative_hits;
+    uint64_t  misses;
+    uint64_t  coalesced;   //< joined a query already in flight
+    size_t    entries;
+  };
+
+  // getaddrinfo() doesn't report record TTLs, so the TTLs are fixed.
+  dns_cache(std::chrono::seconds ttl, std::chrono::seconds negative_ttl,
+    size_t max_entries);
+
+  // |handler| is posted to |ioc|, the io_context of the caller. The
+  // query, if any, runs on |ioc| too. Returns the ticket of the wait for
+  // cancel(), 0 when the answer was cached and |handler| already posted.
+  uint64_t async_resolve(io_context& ioc, const std::string& hostname,
+    resolve_handler handler);
+
+  // Drops the wait, the query itself goes on for the others. Returns
+  // false if it is too late, |handler| is posted or about to be then.
+  bool cancel(const std::string& hostname, uint64_t ticket);
+
+  // Can be called from any thread.
+  void get_stats(stats& st) const;
+
+private:
+  struct waiter {
+    uint64_t         ticket;
+    io_context*      pioc;
+    resolve_handler  handler;
+  };
+
+  struct entry {
+    bool                                   pending;
+    error_code                             err;
+    address_list                           addrs;
+    std::chrono::steady_clock::time_point  expires;
+    std::vector<waiter>                    waiters;
+
+    entry(): pending(false) {}
+  };
+
+  typedef boost::asio::ip::tcp::resolver resolver;
+
+  void handle_resolve(std::shared_ptr<resolver>, const std::string&,
+    error_code, resolver::results_type);
+  void make_room();
+
+private:
+  std::chrono::seconds                    ttl_;
+  std::chrono::seconds                    negative_ttl_;
+  size_t                                  max_entries_;
+
+  mutable std::mutex                      mutex_;
+  std::unordered_map<std::string, entry>  entries_;
+  uint64_t                                next_ticket_;
+
+  std::atomic<uint64_t>                   hits_;
+  std::atomic<uint64_t>                   negative_hits_;
+  std::atomic<uint64_t>                   misses_;
+  std::atomic<uint64_t>                   coalesced_;
+};
+
+}}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <new>
+#include <type_traits>
+
+#include <stddef.h>
+
+namespace proxyswiss {
+namespace detail {
+
+// Room for one pending operation at a time, reused by the next one.
+// Asio frees an operation's memory before calling its handler, so a chain
+// of operations started one after another needs a single handler_memory.
+// Operations too big for it, or started while it is in use, go to the
+// heap.
+// Used by the relays, which run once per chunk; bench/relay_alloc_check
+// fails if they allocate. The handshakes run once per connection and keep
+// their std::function handlers, handshake_bench counts what they cost.
+class handler_memory {
+public:
+  handler_memory(): in_use_(false)
+  {
+  }
+
+  void* allocate(size_t size) {
+    if (!in_use_ && size <= sizeof(storage_)) {
+      in_use_ = true;
+      return &storage_;
+    }
+    return ::operator new(size);
+  }
+
+  void deallocate(void* p) {
+    if (p == &storage_) {
+      in_use_ = false;
+    }
+    else {
+      ::operator delete(p);
+    }
+  }
+
+private:
+  handler_memory(const handler_memory&) = delete;
+  handler_memory& operator=(const handler_memory&) = delete;
+
+private:
+  std::aligned_storage<512>::type  storage_;
+  bool                             in_use_;
+};
+
+// Associated allocator handing out |handler_memory|.
+template <typename T>
+class handler_allocator {
+public:
+  typedef T value_type;
+
+  explicit handler_allocator(handler_memory& mem): memory_(&mem)
+  {
+  }
+
+  template <typename U>
+  handler_allocator(const handler_allocator<U>& other) noexcept
+    : memory_(other.memory_)
+  {
+  }
+
+  bool operator==(const handler_allocator& other) const noexcept {
+    return memory_ == other.memory_;
+  }
+
+  bool operator!=(const handler_allocator& other) const noexcept {
+    return memory_ != other.memory_;
+  }
+
+  T* allocate(size_t n) const {
+    return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T* p, size_t) const {
+    memory_->deallocate(p);
+  }
+
+private:
+  template <typename> friend class handler_allocator;
+
+  handler_memory*  memory_;
+};
+
+}}
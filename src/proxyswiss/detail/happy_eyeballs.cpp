@@ -0,0 +1,202 @@
+#include "proxyswiss/detail/happy_eyeballs.h"
+
+#include "proxyswiss/detail/socket_tuning.h"
+
+#include <boost/asio/error.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <assert.h>
+
+#define dbgprint(...) __noop
+
+using namespace std;
+using namespace boost::asio::ip;
+using namespace boost::placeholders;
+
+namespace proxyswiss {
+namespace detail {
+
+// Alternate the families, starting with the one the resolver put first
+// (RFC 8305, section 4).
+static dns_cache::address_list interleave_families(
+  const dns_cache::address_list& addrs)
+{
+  if (addrs.empty()) {
+    return addrs;
+  }
+
+  const bool first_v6 = addrs[0].is_v6();
+  dns_cache::address_list first, second;
+  for (size_t i = 0; i < addrs.size(); i++) {
+    if (addrs[i].is_v6() == first_v6) {
+      first.push_back(addrs[i]);
+    }
+    else {
+      second.push_back(addrs[i]);
+    }
+  }
+
+  dns_cache::address_list result;
+  for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+    if (i < first.size()) {
+      result.push_back(first[i]);
+    }
+    if (i < second.size()) {
+      result.push_back(second[i]);
+    }
+  }
+  return result;
+}
+
+shared_ptr<happy_eyeballs> happy_eyeballs::async_connect(io_context& ioc,
+  socket& sock,
+  const dns_cache::address_list& addrs, uint16_t port,
+  chrono::milliseconds attempt_delay, chrono::milliseconds timeout,
+  connect_handler handler, const config::socket_profile* prof,
+  bool fastopen)
+{
+  shared_ptr<happy_eyeballs> he(new happy_eyeballs(ioc, sock, addrs, port,
+    attempt_delay, handler, prof, fastopen));
+  he->start(timeout);
+  return he;
+}
+
+void happy_eyeballs::cancel() {
+  if (done_) {
+    return;
+  }
+
+  dbgprint("cancelled, %d attempts pending\n", pending_);
+
+  finish(boost::asio::error::timed_out);
+}
+
+happy_eyeballs::happy_eyeballs(io_context& ioc, socket& sock,
+  const dns_cache::address_list& addrs, uint16_t port,
+  chrono::milliseconds attempt_delay, connect_handler handler,
+  const config::socket_profile* prof, bool fastopen)
+  :
+  ioc_(ioc), sock_(sock), addrs_(interleave_families(addrs)), port_(port),
+  attempt_delay_(attempt_delay), handler_(handler), prof_(prof),
+  fastopen_(fastopen && addrs.size() == 1), pending_(0),
+  done_(false), attempt_timer_(ioc), deadline_timer_(ioc)
+{
+}
+
+void happy_eyeballs::start(chrono::milliseconds timeout) {
+  if (addrs_.empty()) {
+    finish(boost::asio::error::host_not_found);
+    return;
+  }
+
+  if (timeout.count()) {
+    deadline_timer_.expires_after(timeout);
+    deadline_timer_.async_wait(
+      boost::bind(&happy_eyeballs::handle_deadline, shared_from_this(), _1));
+  }
+
+  start_next();
+}
+
+void happy_eyeballs::start_next() {
+  const size_t index = attempts_.size();
+  assert(index < addrs_.size());
+
+  dbgprint("attempt %d: %s\n", index, addrs_[index].to_string().c_str());
+
+  const tcp::endpoint ep(addrs_[index], port_);
+  attempts_.push_back(unique_ptr<socket>(new socket(ioc_)));
+  if (prof_) {
+    // If open() fails, async_connect() fails the same way.
+    error_code ec;
+    attempts_.back()->open(ep.protocol(), ec);
+    if (!ec) {
+      tune_unconnected(*attempts_.back(), *prof_, fastopen_);
+    }
+  }
+  ++pending_;
+  attempts_.back()->async_connect(ep,
+    boost::bind(&happy_eyeballs::handle_connect, shared_from_this(),
+      index, _1));
+
+  if (attempts_.size() < addrs_.size()) {
+    attempt_timer_.expires_after(attempt_delay_);
+    attempt_timer_.async_wait(
+      boost::bind(&happy_eyeballs::handle_attempt_timer, shared_from_this(),
+        _1));
+  }
+}
+
+void happy_eyeballs::finish(error_code err) {
+  assert(!done_);
+  done_ = true;
+
+  error_code ec;
+  attempt_timer_.cancel(ec);
+  deadline_timer_.cancel(ec);
+  close_attempts();
+
+  connect_handler handler_copy = handler_;
+  handler_ = connect_handler();
+  handler_copy(err);
+}
+
+void happy_eyeballs::close_attempts() {
+  error_code ec;
+  for (size_t i = 0; i < attempts_.size(); i++) {
+    attempts_[i]->close(ec);
+  }
+}
+
+void happy_eyeballs::handle_connect(size_t index, error_code err) {
+  --pending_;
+  if (done_) {
+    return;
+  }
+
+  if (err) {
+    dbgprint("attempt %d: error %s.%d\n", index, err.category().name(),
+      err.value());
+
+    last_err_ = err;
+    error_code ec;
+    attempts_[index]->close(ec);
+
+    // Don't wait for the timer, the next address may answer.
+    if (attempts_.size() < addrs_.size()) {
+      start_next();
+    }
+    else if (!pending_) {
+      finish(last_err_);
+    }
+    return;
+  }
+
+  dbgprint("attempt %d: ok\n", index);
+
+  sock_ = std::move(*attempts_[index]);
+  finish(error_code());
+}
+
+void happy_eyeballs::handle_attempt_timer(error_code err) {
+  // Rearmed or cancelled since.
+  if (err || done_ || attempt_timer_.expiry() > chrono::steady_clock::now())
+  {
+    return;
+  }
+  if (attempts_.size() < addrs_.size()) {
+    start_next();
+  }
+}
+
+void happy_eyeballs::handle_deadline(error_code err) {
+  if (err || done_) {
+    return;
+  }
+
+  dbgprint("timed out, %d attempts pending\n", pending_);
+
+  finish(boost::asio::error::timed_out);
+}
+
+}}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "proxyswiss/config.h"
+#include "proxyswiss/detail/dns_cache.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace proxyswiss {
+namespace detail {
+
+// Connects to the first of several addresses that answers (RFC 8305).
+// Attempts start |attempt_delay| apart, alternating address families, or
+// right away when the previous one fails. The winner is moved into the
+// caller's socket, the others are closed.
+class happy_eyeballs: public std::enable_shared_from_this<happy_eyeballs> {
+public:
+  typedef boost::asio::io_context io_context;
+  typedef boost::asio::ip::tcp::socket socket;
+  typedef boost::system::error_code error_code;
+  typedef std::function<void(error_code)> connect_handler;
+
+  // |sock| must outlive the connect. A |timeout| of 0 means no deadline
+  // other than the OS one. |handler| is called exactly once. |prof|, if
+  // any, goes to tune_unconnected() on every attempt before it connects;
+  // |prof| must outlive the connect too. |fastopen| is only passed on with
+  // a single address: a fast open connect with a cookie succeeds before
+  // the SYN is sent, so the first attempt would always win the race.
+  // The connect keeps itself alive, hold on to the result only to cancel.
+  static std::shared_ptr<happy_eyeballs> async_connect(io_context& ioc,
+    socket& sock, const dns_cache::address_list& addrs, uint16_t port,
+    std::chrono::milliseconds attempt_delay,
+    std::chrono::milliseconds timeout,
+    connect_handler handler,
+    const config::socket_profile* prof = nullptr,
+    bool fastopen = false);
+
+  // Fails the connect with timed_out, unless it is done already. The
+  // handler is called from here then, and the attempts are closed.
+  void cancel();
+
+private:
+  happy_eyeballs(io_context& ioc, socket& sock,
+    const dns_cache::address_list& addrs, uint16_t port,
+    std::chrono::milliseconds attempt_delay, connect_handler handler,
+    const config::socket_profile* prof, bool fastopen);
+
+  void start(std::chrono::milliseconds timeout);
+  void start_next();
+  void finish(error_code);
+  void close_attempts();
+
+  void handle_connect(size_t, error_code);
+  void handle_attempt_timer(error_code);
+  void handle_deadline(error_code);
+
+private:
+  io_context&                           ioc_;
+  socket&                               sock_;
+  dns_cache::address_list               addrs_;
+  uint16_t                              port_;
+  std::chrono::milliseconds             attempt_delay_;
+  connect_handler                       handler_;
+  const config::socket_profile*         prof_;
+  bool                                  fastopen_;
+
+  std::vector<std::unique_ptr<socket>>  attempts_;
+  size_t                                pending_;
+  bool                                  done_;
+  error_code                            last_err_;
+  boost::asio::steady_timer             attempt_timer_;
+  boost::asio::steady_timer             deadline_timer_;
+};
+
+}}
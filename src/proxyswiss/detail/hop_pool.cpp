@@ -0,0 +1,244 @@
+#include "proxyswiss/detail/hop_pool.h"
+
+#include "proxyswiss/detail/socket_tuning.h"
+
+#include <boost/bind/bind.hpp>
+
+#include <assert.h>
+
+#define dbgprint(...) __noop
+
+using namespace std;
+using namespace boost::asio::ip;
+using namespace boost::placeholders;
+
+namespace proxyswiss {
+namespace detail {
+
+// Proxies tend to drop idle clients, don't hand out older connections.
+static const std::chrono::seconds kMaxIdleTime(30);
+// Pause before refilling again after a failed connect.
+static const std::chrono::seconds kRetryDelay(1);
+// How often idle connections are checked, and replaced if they would be
+// too old by the next check.
+static const std::chrono::seconds kMaintenanceInterval(5);
+
+hop_pool::hop_pool(io_context& ioc, const config::output_t& cfg_output,
+  size_t size, std::shared_ptr<dns_cache> dns_cache_sptr)
+  :
+  ioc_(ioc), cfg_output_(cfg_output), size_(size), connecting_(0),
+  dns_cache_sptr_(dns_cache_sptr), retry_timer_(ioc), retry_pending_(false),
+  maintenance_timer_(ioc), stopped_(true), hits_(0), misses_(0), failed_(0)
+{
+  assert(!cfg_output_.proxy_chain.empty());
+}
+
+void hop_pool::start() {
+  stopped_ = false;
+  refill();
+  begin_maintenance();
+}
+
+void hop_pool::stop() {
+  stopped_ = true;
+
+  error_code ec;
+  retry_timer_.cancel(ec);
+  maintenance_timer_.cancel(ec);
+  for (size_t i = 0; i < ready_.size(); i++) {
+    ready_[i]->sock.close(ec);
+  }
+  ready_.clear();
+}
+
+bool hop_pool::take(socket& sock) {
+  expire(std::chrono::steady_clock::now());
+
+  // The most recent one is the most likely to be alive.
+  while (!ready_.empty()) {
+    entry_shared_ptr e(ready_.back());
+    ready_.pop_back();
+
+    if (!is_alive(e->sock)) {
+      dbgprint("pooled connection is dead\n");
+      error_code ec;
+      e->sock.close(ec);
+      continue;
+    }
+
+    sock = std::move(e->sock);
+    hits_.store(hits_.load(memory_order_relaxed) + 1, memory_order_relaxed);
+
+    refill();
+    return true;
+  }
+
+  misses_.store(misses_.load(memory_order_relaxed) + 1,
+    memory_order_relaxed);
+
+  refill();
+  return false;
+}
+
+void hop_pool::expire(std::chrono::steady_clock::time_point now) {
+  // The oldest ones expire first.
+  while (!ready_.empty() && now - ready_.front()->ready_since > kMaxIdleTime)
+  {
+    error_code ec;
+    ready_.front()->sock.close(ec);
+    ready_.pop_front();
+  }
+}
+
+void hop_pool::begin_maintenance() {
+  maintenance_timer_.expires_after(kMaintenanceInterval);
+  maintenance_timer_.async_wait(
+    boost::bind(&hop_pool::handle_maintenance_timer, shared_from_this(),
+      _1));
+}
+
+void hop_pool::handle_maintenance_timer(error_code err) {
+  if (err || stopped_) {
+    return;
+  }
+
+  // Replace a round early, so that take() finds them young enough under
+  // light load too.
+  expire(std::chrono::steady_clock::now() + kMaintenanceInterval);
+
+  for (size_t i = 0; i < ready_.size(); ) {
+    if (!is_alive(ready_[i]->sock)) {
+      dbgprint("pooled connection is dead\n");
+      error_code ec;
+      ready_[i]->sock.close(ec);
+      ready_.erase(ready_.begin() + i);
+      continue;
+    }
+    i++;
+  }
+
+  refill();
+  begin_maintenance();
+}
+
+void hop_pool::get_stats(stats& st) const {
+  st.hits = hits_.load(memory_order_relaxed);
+  st.misses = misses_.load(memory_order_relaxed);
+  st.failed = failed_.load(memory_order_relaxed);
+}
+
+bool hop_pool::is_alive(socket& sock) {
+  // Nothing must be readable on an idle connection: eof means the proxy
+  // has closed it, data means it is out of sync.
+  error_code ec, ec2;
+  sock.non_blocking(true, ec);
+  if (ec) {
+    return false;
+  }
+  char c;
+  sock.receive(boost::asio::buffer(&c, 1), socket::message_peek, ec);
+  sock.non_blocking(false, ec2);
+
+  return ec == boost::asio::error::would_block && !ec2;
+}
+
+void hop_pool::refill() {
+  while (!stopped_ && !retry_pending_ && ready_.size() + connecting_ < size_)
+  {
+    begin_connect();
+  }
+}
+
+void hop_pool::begin_connect() {
+  const config::proxy_client_info& hop(cfg_output_.proxy_chain[0]);
+
+  entry_shared_ptr e(new entry(ioc_));
+  e->cli_sess.reset(proxy::create_client_session(e->sock,
+    hop.proxy_client_type, hop.proxy_creds, "hop_pool", cfg_output_.engine));
+
+  ++connecting_;
+
+  if (hop.proxy_address.using_hostname()) {
+    dns_cache_sptr_->async_resolve(ioc_, hop.proxy_address.hostname,
+      boost::bind(&hop_pool::handle_resolve, shared_from_this(), e,
+        _1, _2));
+  }
+  else {
+    handle_resolve(e, error_code(),
+      dns_cache::address_list(1, hop.proxy_address.ip_address));
+  }
+}
+
+void hop_pool::handle_resolve(entry_shared_ptr e, error_code err,
+  const dns_cache::address_list& addrs)
+{
+  if (err || stopped_) {
+    connect_failed();
+    return;
+  }
+
+  happy_eyeballs::async_connect(ioc_, e->sock, addrs,
+    cfg_output_.proxy_chain[0].proxy_address.port,
+    std::chrono::milliseconds(cfg_output_.connect_attempt_delay),
+    std::chrono::seconds(cfg_output_.connect_timeout),
+    boost::bind(&hop_pool::handle_connect, shared_from_this(), e, _1),
+    &cfg_output_.sock_profile, true/*fastopen, we send the greeting*/);
+}
+
+void hop_pool::handle_connect(entry_shared_ptr e, error_code err) {
+  if (err || stopped_) {
+    connect_failed();
+    return;
+  }
+
+  tune_connected(e->sock, cfg_output_.sock_profile);
+
+  e->cli_sess->authenticate(
+    boost::bind(&hop_pool::handle_authenticate, shared_from_this(), e,
+      _1));
+}
+
+void hop_pool::handle_authenticate(entry_shared_ptr e, error_code err) {
+  if (err || stopped_) {
+    dbgprint("can't authenticate, error %s.%d\n", err.category().name(),
+      err.value());
+
+    error_code ec;
+    e->sock.close(ec);
+    connect_failed();
+    return;
+  }
+
+  --connecting_;
+
+  e->ready_since = std::chrono::steady_clock::now();
+  ready_.push_back(e);
+}
+
+void hop_pool::connect_failed() {
+  --connecting_;
+
+  if (stopped_) {
+    return;
+  }
+
+  failed_.store(failed_.load(memory_order_relaxed) + 1,
+    memory_order_relaxed);
+
+  if (!retry_pending_) {
+    retry_pending_ = true;
+    retry_timer_.expires_after(kRetryDelay);
+    retry_timer_.async_wait(
+      boost::bind(&hop_pool::handle_retry_timer, shared_from_this(), _1));
+  }
+}
+
+void hop_pool::handle_retry_timer(error_code err) {
+  retry_pending_ = false;
+  if (err) {
+    return;
+  }
+  refill();
+}
+
+}}
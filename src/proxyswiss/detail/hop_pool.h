@@ -0,0 +1,94 @@
+#pragma once
+
+#include "proxyswiss/config.h"
+#include "proxyswiss/detail/dns_cache.h"
+#include "proxyswiss/detail/happy_eyeballs.h"
+
+#include "proxy/client_session.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+
+namespace proxyswiss {
+namespace detail {
+
+// Warm connections to proxy_chain[0], connected and authenticated ahead
+// of time, so that only the CONNECT request is left on the critical path.
+// Refills in the background, and replaces connections before they get
+// too old to hand out. Not thread safe, one pool per worker.
+class hop_pool: public boost::enable_shared_from_this<hop_pool> {
+public:
+  typedef boost::asio::io_context io_context;
+  typedef boost::asio::ip::tcp::socket socket;
+  typedef boost::system::error_code error_code;
+
+  struct stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t failed; //< connects/auths that failed while refilling
+  };
+
+  hop_pool(io_context& ioc, const config::output_t& cfg_output,
+    size_t size, std::shared_ptr<dns_cache> dns_cache_sptr);
+
+  void start();
+  void stop();
+
+  // Moves a ready connection to |sock|. Returns false if there is none,
+  // the caller connects the usual way then.
+  bool take(socket& sock);
+
+  // Can be called from any thread.
+  void get_stats(stats& st) const;
+
+private:
+  struct entry {
+    socket                                  sock;
+    std::unique_ptr<proxy::client_session>  cli_sess;
+    std::chrono::steady_clock::time_point   ready_since;
+
+    entry(io_context& ioc): sock(ioc) {}
+  };
+  typedef boost::shared_ptr<entry> entry_shared_ptr;
+
+  void refill();
+  // Closes the connections that are too old by |now|.
+  void expire(std::chrono::steady_clock::time_point now);
+  void begin_maintenance();
+  void handle_maintenance_timer(error_code);
+  void begin_connect();
+  void handle_resolve(entry_shared_ptr, error_code,
+    const dns_cache::address_list&);
+  void handle_connect(entry_shared_ptr, error_code);
+  void handle_authenticate(entry_shared_ptr, error_code);
+  void connect_failed();
+  void handle_retry_timer(error_code);
+
+  static bool is_alive(socket&);
+
+private:
+  io_context&                   ioc_;
+  const config::output_t&       cfg_output_;
+  size_t                        size_;
+  std::deque<entry_shared_ptr>  ready_;
+  size_t                        connecting_;
+  std::shared_ptr<dns_cache>    dns_cache_sptr_;
+  boost::asio::steady_timer     retry_timer_;
+  bool                          retry_pending_;
+  boost::asio::steady_timer     maintenance_timer_;
+  bool                          stopped_;
+
+  std::atomic<uint64_t>         hits_;
+  std::atomic<uint64_t>         misses_;
+  std::atomic<uint64_t>         failed_;
+};
+
+}}
@@ -12,13 +12,16 @@ namespace proxyswiss {
 namespace detail {
 
 input::input(socket& sock, const config::input_t& cfg_input,
-  const string& dbglog_uid)
+  const string& dbglog_uid, proxy::session_arena& arena)
   :
-  sock_(sock), cfg_input_(cfg_input)
+  sock_(sock), cfg_input_(cfg_input),
+  srv_sess_uptr_(nullptr, proxy::session_arena::deleter<
+    proxy::server_session>(&arena))
 {
   if (cfg_input_.type == config::eProxyServer) {
     srv_sess_uptr_.reset(proxy::create_server_session(sock_,
-      cfg_input_.as_proxy_server.proxy_server_type, dbglog_uid));
+      cfg_input_.as_proxy_server.proxy_server_type, dbglog_uid,
+      cfg_input_.engine, &arena));
   }
 }
 
@@ -54,4 +57,15 @@ void input::write_connect_response(
   }
 }
 
+void input::take_unread_data(string& data) {
+  data.clear();
+  if (srv_sess_uptr_) {
+    data.swap(srv_sess_uptr_->unread_data());
+  }
+}
+
+void input::free_handshake_state() {
+  srv_sess_uptr_.reset();
+}
+
 }}
@@ -5,6 +5,7 @@
 
 #include "proxy/destination.h"
 #include "proxy/connect_response.h"
+#include "proxy/session_arena.h"
 
 #include <memory>
 
@@ -20,8 +21,9 @@ public:
   typedef std::function<void(error_code)> read_request_handler;
   typedef std::function<void(error_code)> write_response_handler;
 
+  // The server session is created in |arena|, which must outlive input.
   input(socket& sock, const config::input_t& cfg_input,
-    const std::string& dbglog_uid);
+    const std::string& dbglog_uid, proxy::session_arena& arena);
 
   // ---
 
@@ -33,10 +35,20 @@ public:
     const proxy::connect_response& conn_resp,
     write_response_handler handler);
 
+  // Moves the client data read ahead during the handshake to |data|.
+  void take_unread_data(std::string& data);
+
+  // The handshake is over, drop the protocol state.
+  void free_handshake_state();
+
 private:
+  typedef std::unique_ptr<proxy::server_session,
+    proxy::session_arena::deleter<proxy::server_session>>
+    server_session_uptr;
+
   socket&                                 sock_;
   const config::input_t&                  cfg_input_;
-  std::unique_ptr<proxy::server_session>  srv_sess_uptr_;
+  server_session_uptr                     srv_sess_uptr_;
 };
 
 }}
@@ -0,0 +1,147 @@
+#include "proxyswiss/detail/latency_histogram.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <assert.h>
+
+using namespace std;
+
+namespace proxyswiss {
+namespace detail {
+
+// Single writer, no need for a locked add.
+static inline void add_relaxed(atomic<uint64_t>& a, uint64_t v) {
+  a.store(a.load(memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+static inline unsigned highest_bit(uint64_t v) {
+  assert(v != 0);
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse64(&index, v);
+  return index;
+#else
+  return 63 - __builtin_clzll(v);
+#endif
+}
+
+latency_histogram::latency_histogram(): count_(0), sum_(0), max_(0) {
+  for (unsigned i = 0; i < kNumBuckets; i++) {
+    counts_[i].store(0, memory_order_relaxed);
+  }
+}
+
+unsigned latency_histogram::bucket_index(uint64_t usec) {
+  if (usec < kSubBuckets) {
+    return static_cast<unsigned>(usec);
+  }
+  const unsigned msb = highest_bit(usec);
+  if (msb >= kMaxBits) {
+    return kNumBuckets - 1;
+  }
+  const unsigned shift = msb - kSubBucketBits;
+  return (shift + 1) * kSubBuckets +
+    static_cast<unsigned>((usec >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t latency_histogram::bucket_highest(unsigned index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  const unsigned shift = index / kSubBuckets - 1;
+  const uint64_t lowest =
+    static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+  return lowest + (static_cast<uint64_t>(1) << shift) - 1;
+}
+
+void latency_histogram::record(uint64_t usec) {
+  add_relaxed(counts_[bucket_index(usec)], 1);
+  add_relaxed(count_, 1);
+  add_relaxed(sum_, usec);
+  if (usec > max_.load(memory_order_relaxed)) {
+    max_.store(usec, memory_order_relaxed);
+  }
+}
+
+void latency_histogram::add_to(snapshot& snap) const {
+  for (unsigned i = 0; i < kNumBuckets; i++) {
+    snap.counts[i] += counts_[i].load(memory_order_relaxed);
+  }
+  snap.count += count_.load(memory_order_relaxed);
+  snap.sum += sum_.load(memory_order_relaxed);
+  const uint64_t m = max_.load(memory_order_relaxed);
+  if (m > snap.max) {
+    snap.max = m;
+  }
+}
+
+latency_histogram::snapshot&
+latency_histogram::snapshot::operator+=(const snapshot& other)
+{
+  for (unsigned i = 0; i < kNumBuckets; i++) {
+    counts[i] += other.counts[i];
+  }
+  count += other.count;
+  sum += other.sum;
+  if (other.max > max) {
+    max = other.max;
+  }
+  return *this;
+}
+
+uint64_t latency_histogram::snapshot::percentile(double p) const {
+  // The buckets are read one by one while the owner keeps writing, so
+  // they may add up to more (or less) than |count|. Use their sum.
+  uint64_t total = 0;
+  for (unsigned i = 0; i < kNumBuckets; i++) {
+    total += counts[i];
+  }
+  if (!total) {
+    return 0;
+  }
+
+  uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  if (rank > total) {
+    rank = total;
+  }
+
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < kNumBuckets; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      const uint64_t v = bucket_highest(i);
+      return v < max ? v : max;
+    }
+  }
+  return max;
+}
+
+uint64_t latency_histogram::snapshot::mean() const {
+  return count ? sum / count : 0;
+}
+
+// ---
+
+latency_stats::latency_stats(size_t chain_size) {
+  for (size_t i = 0; i < chain_size + 1; i++) {
+    hop_connect.push_back(
+      unique_ptr<latency_histogram>(new latency_histogram));
+  }
+}
+
+void latency_stats::add_to(snapshot& snap) const {
+  handshake_read.add_to(snap.handshake_read);
+  snap.hop_connect.resize(hop_connect.size());
+  for (size_t i = 0; i < hop_connect.size(); i++) {
+    hop_connect[i]->add_to(snap.hop_connect[i]);
+  }
+  response_write.add_to(snap.response_write);
+  tunnel_lifetime.add_to(snap.tunnel_lifetime);
+}
+
+}}
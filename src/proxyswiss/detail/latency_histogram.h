@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace proxyswiss {
+namespace detail {
+
+// Log-linear histogram of durations in microseconds, HDR style: every
+// power of two is split into 16 buckets, so a value is off by at most
+// 1/16. Written by one thread (the owning worker), snapshots can be taken
+// from any thread.
+class latency_histogram {
+public:
+  static const unsigned kSubBucketBits = 4;
+  static const unsigned kSubBuckets = 1 << kSubBucketBits;
+  // Values from 2^37 us (~38 hours) on land in the last bucket.
+  static const unsigned kMaxBits = 37;
+  static const unsigned kNumBuckets =
+    kSubBuckets * (kMaxBits - kSubBucketBits + 1);
+
+  struct snapshot {
+    std::vector<uint64_t>  counts;
+    uint64_t               count;
+    uint64_t               sum;
+    uint64_t               max;
+
+    snapshot(): counts(kNumBuckets), count(0), sum(0), max(0)
+    {
+    }
+
+    snapshot& operator+=(const snapshot& other);
+
+    // |p| is 0 .. 100. Returns the highest value of the bucket holding the
+    // p-th percentile, 0 if empty.
+    uint64_t percentile(double p) const;
+    uint64_t mean() const;
+  };
+
+  latency_histogram();
+
+  void record(uint64_t usec);
+  void record(std::chrono::steady_clock::duration d) {
+    record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(d).count()));
+  }
+
+  // Adds to |snap|.
+  void add_to(snapshot& snap) const;
+
+  static unsigned bucket_index(uint64_t usec);
+  static uint64_t bucket_highest(unsigned index);
+
+private:
+  latency_histogram(const latency_histogram&) = delete;
+  latency_histogram& operator=(const latency_histogram&) = delete;
+
+private:
+  std::atomic<uint64_t>  counts_[kNumBuckets];
+  std::atomic<uint64_t>  count_;
+  std::atomic<uint64_t>  sum_;
+  std::atomic<uint64_t>  max_;
+};
+
+// Session stages, per worker.
+struct latency_stats {
+  // Reading the connect request from the client.
+  latency_histogram  handshake_read;
+  // [0]: resolving and connecting to the first hop (or the destination
+  // if there is no chain), [i+1]: CONNECT through proxy_chain[i].
+  // Successful steps only.
+  std::vector<std::unique_ptr<latency_histogram>>  hop_connect;
+  // Writing the connect response back to the client.
+  latency_histogram  response_write;
+  // From the end of the handshake to the end of the session.
+  latency_histogram  tunnel_lifetime;
+
+  struct snapshot {
+    latency_histogram::snapshot               handshake_read;
+    std::vector<latency_histogram::snapshot>  hop_connect;
+    latency_histogram::snapshot               response_write;
+    latency_histogram::snapshot               tunnel_lifetime;
+  };
+
+  explicit latency_stats(size_t chain_size);
+
+  void add_to(snapshot& snap) const;
+};
+
+}}
@@ -1,6 +1,8 @@
 
 #include "proxyswiss/detail/output.h"
 
+#include "proxyswiss/detail/socket_tuning.h"
+
 #include "proxy/client_session.h"
 
 #include "common/base/str.h"
@@ -20,24 +22,37 @@ namespace proxyswiss {
 namespace detail {
 
 output::output(io_context& ioc, socket& sock, const config::output_t& cfg_output,
-  const string& dbglog_uid)
-  : ioc_(ioc), sock_(sock), cfg_output_(cfg_output), dbglog_uid_(dbglog_uid)
+  worker_context& ctx, const string& dbglog_uid,
+  proxy::session_arena& arena)
+  : ioc_(ioc), sock_(sock), cfg_output_(cfg_output), ctx_(ctx),
+    dbglog_uid_(dbglog_uid),
+    chain_(proxy::session_arena::allocator<client_session_uptr>(&arena)),
+    hop_timer_(&output::handle_hop_deadline, this),
+    hop_timed_out_(false), resolve_host_(nullptr), resolve_ticket_(0)
 {
-  create_chain(dbglog_uid);
+  create_chain(dbglog_uid, arena);
 }
 
-void output::create_chain(const string& dbglog_uid) {
+void output::create_chain(const string& dbglog_uid,
+  proxy::session_arena& arena)
+{
+  chain_.reserve(cfg_output_.proxy_chain.size());
   for (size_t i = 0; i < cfg_output_.proxy_chain.size(); i++) {
-    chain_.push_back(unique_ptr<proxy::client_session>());
-    chain_.back().reset(
+    chain_.push_back(client_session_uptr(
       proxy::create_client_session(sock_,
         cfg_output_.proxy_chain[i].proxy_client_type,
         cfg_output_.proxy_chain[i].proxy_creds,
-        dbglog_uid));
+        dbglog_uid,
+        cfg_output_.engine,
+        &arena),
+      proxy::session_arena::deleter<proxy::client_session>(&arena)));
+    chain_.back()->set_optimistic(cfg_output_.proxy_chain[i].optimistic);
   }
 }
 
 void output::call_and_clear_handler(connect_result cr) {
+  ctx_.wheel_uptr->cancel(hop_timer_);
+
   connect_handler handler_copy = user_connect_handler_;
   user_connect_handler_ = connect_handler();
   handler_copy(cr);
@@ -51,45 +66,101 @@ void output::connect_through_chain(const proxy::destination& dst,
   final_dst_ = dst;
   user_connect_handler_ = handler;
   cur_proxy_ = 0;
+  hop_start_ = chrono::steady_clock::now();
+  hop_timed_out_ = false;
+  arm_hop_timer();
 
   if (chain_.empty()) {
     if (dst.using_hostname()) {
-      resolver_uptr_.reset(new resolver(ioc_));
-      tcp::resolver::query query(dst.hostname, "");
-      resolver_uptr_->async_resolve(query,
-        boost::bind(&output::handle_resolve, this,
-          _1, _2, final_dst_.port, connect_result::kNoIndex));
+      resolve(final_dst_.hostname, final_dst_.port,
+        connect_result::kNoIndex);
     }
     else {
-      sock_.async_connect(tcp::endpoint(dst.ip_address, dst.port),
-        boost::bind(&output::handle_connect, this,
-          _1, connect_result::kNoIndex));
+      connect_first(dns_cache::address_list(1, dst.ip_address), dst.port,
+        connect_result::kNoIndex);
     }
   }
   else {
-    proxy::destination first_proxy(
+    // A warm connection to the first proxy, already authenticated ?
+    if (ctx_.hop_pool_sptr && ctx_.hop_pool_sptr->take(sock_)) {
+      dbgprint("[%s] using pooled connection (chain[0])\n",
+        dbglog_uid_.c_str());
+
+      chain_[0]->set_authenticated();
+      connect_next(boost::system::error_code(), 0);
+      return;
+    }
+
+    const proxy::destination& first_proxy(
       cfg_output_.proxy_chain[0].proxy_address);
 
     if (first_proxy.using_hostname()) {
-      resolver_uptr_.reset(new resolver(ioc_));
-      tcp::resolver::query query(first_proxy.hostname, "");
-      resolver_uptr_->async_resolve(query,
-        boost::bind(&output::handle_resolve, this,
-          _1, _2, first_proxy.port, 0/*index*/));
+      resolve(first_proxy.hostname, first_proxy.port, 0/*index*/);
     }
     else {
-      sock_.async_connect(
-        tcp::endpoint(first_proxy.ip_address, first_proxy.port),
-        boost::bind(&output::handle_connect, this, _1, 0));
+      connect_first(dns_cache::address_list(1, first_proxy.ip_address),
+        first_proxy.port, 0);
     }
   }
 }
 
-void output::handle_resolve(error_code err, resolver::iterator it,
-  uint16_t port, size_t index)
-{
-  resolver_uptr_.reset();
+void output::free_handshake_state() {
+  assert(!user_connect_handler_);
+
+  chain(chain_.get_allocator()).swap(chain_);
+}
+
+void output::arm_hop_timer() {
+  if (cfg_output_.hop_timeout) {
+    ctx_.wheel_uptr->arm(hop_timer_,
+      chrono::seconds(cfg_output_.hop_timeout));
+  }
+}
+
+void output::handle_hop_deadline(void* arg) {
+  output* self = static_cast<output*>(arg);
+
+  dbgprint("[%s] hop timed out (chain[%d])\n", self->dbglog_uid_.c_str(),
+    self->cur_proxy_);
+
+  // Whatever is pending on the socket fails, and turns into timed_out.
+  self->hop_timed_out_ = true;
+  self->ctx_.counters.hop_timeouts.add(1);
+  error_code ec;
+  self->sock_.close(ec);
+
+  // The resolve and the connect race don't use the socket, don't wait
+  // for getaddrinfo() or the OS to give up on them.
+  if (self->resolve_ticket_ &&
+      self->ctx_.dns_cache_sptr->cancel(*self->resolve_host_,
+        self->resolve_ticket_))
+  {
+    self->resolve_ticket_ = 0;
+    // Only the first hop is resolved here.
+    self->handle_resolve(boost::asio::error::timed_out,
+      dns_cache::address_list(), 0,
+      self->chain_.empty() ? connect_result::kNoIndex : 0);
+    return;
+  }
+  if (shared_ptr<happy_eyeballs> he = self->connecting_.lock()) {
+    he->cancel();
+  }
+}
+
+void output::resolve(const string& hostname, uint16_t port, size_t index) {
+  // |hostname| lives in |final_dst_| or the config, as long as we do.
+  resolve_host_ = &hostname;
+  resolve_ticket_ = ctx_.dns_cache_sptr->async_resolve(ioc_, hostname,
+    boost::bind(&output::handle_resolve, this, _1, _2, port, index));
+}
 
+void output::handle_resolve(error_code err,
+  const dns_cache::address_list& addrs, uint16_t port, size_t index)
+{
+  resolve_ticket_ = 0;
+  if (hop_timed_out_) {
+    err = boost::asio::error::timed_out;
+  }
   if (err) {
     dbgprint("[%s] can't resolve, error %s.%d (chain[%d])\n",
       dbglog_uid_.c_str(),
@@ -101,15 +172,42 @@ void output::handle_resolve(error_code err, resolver::iterator it,
     return;
   }
 
-  dbgprint("[%s] %s resolved to %s (chain[%d])\n",
+  dbgprint("[%s] resolved to %d addresses, %s first (chain[%d])\n",
     dbglog_uid_.c_str(),
-    it->host_name().c_str(),
-    it->endpoint().address().to_string().c_str(),
+    addrs.size(),
+    addrs[0].to_string().c_str(),
     index);
 
-  sock_.async_connect(
-    tcp::endpoint(it->endpoint().address(), port),
-    boost::bind(&output::handle_connect, this, _1, index));
+  connect_first(addrs, port, index);
+}
+
+void output::connect_first(const dns_cache::address_list& addrs,
+  uint16_t port, size_t index)
+{
+  connecting_ = happy_eyeballs::async_connect(ioc_, sock_, addrs, port,
+    chrono::milliseconds(cfg_output_.connect_attempt_delay),
+    chrono::seconds(cfg_output_.connect_timeout),
+    boost::bind(&output::handle_connect, this, _1, index),
+    &cfg_output_.sock_profile,
+    // The destination may be waiting for us to speak first, then a SYN
+    // held back for our first write would never go out.
+    index != connect_result::kNoIndex);
+}
+
+void output::record_hop_latency(size_t slot) {
+  const auto now = chrono::steady_clock::now();
+  ctx_.latency_uptr->hop_connect[slot]->record(now - hop_start_);
+  hop_start_ = now;
+}
+
+void output::count_fastopen() {
+  if (!fastopen_connect_enabled(sock_)) {
+    return;
+  }
+  ctx_.counters.fastopen_out_tried.add(1);
+  if (syn_data_acked(sock_)) {
+    ctx_.counters.fastopen_out_acked.add(1);
+  }
 }
 
 void output::connect_next(error_code err, size_t index) {
@@ -141,6 +239,12 @@ void output::connect_next(error_code err, size_t index) {
 }
 
 void output::handle_connect(error_code err, size_t index) {
+  connecting_.reset();
+  if (hop_timed_out_) {
+    // The connect may have won the race, the socket is closed with the
+    // rest of the session then.
+    err = boost::asio::error::timed_out;
+  }
   if (err) {
     dbgprint("[%s] error %s.%d (chain[%d])\n",
       dbglog_uid_.c_str(),
@@ -150,11 +254,17 @@ void output::handle_connect(error_code err, size_t index) {
   }
   else {
     dbgprint("[%s] ok (chain[%d])\n", dbglog_uid_.c_str(), index);
+
+    tune_connected(sock_, cfg_output_.sock_profile);
+    record_hop_latency(0);
   }
   connect_next(err, index);
 }
 
 void output::handle_write_connect_request(error_code err, size_t index) {
+  if (hop_timed_out_) {
+    err = boost::asio::error::timed_out;
+  }
   if (err) {
     dbgprint("[%s] error %s.%d (chain[%d])\n", dbglog_uid_.c_str(),
       err.category().name(), err.value(), index);
@@ -170,6 +280,9 @@ void output::handle_write_connect_request(error_code err, size_t index) {
 }
 
 void output::handle_read_connect_response(error_code err, size_t index) {
+  if (hop_timed_out_) {
+    err = boost::asio::error::timed_out;
+  }
   if (err) {
     dbgprint("[%s] error %s.%d (chain[%d])\n", dbglog_uid_.c_str(),
       err.category().name(), err.value(), index);
@@ -177,6 +290,10 @@ void output::handle_read_connect_response(error_code err, size_t index) {
     call_and_clear_handler(connect_result(false, err, index));
     return;
   }
+  // The first hop answered, its SYN-ACK is long in.
+  if (cur_proxy_ == 0) {
+    count_fastopen();
+  }
   if (conn_resp_.major != proxy::connect_response::eSucceeded) {
     dbgprint("[%s] proxy responded %s (chain[%d])\n",
       dbglog_uid_.c_str(),
@@ -191,7 +308,10 @@ void output::handle_read_connect_response(error_code err, size_t index) {
 
   dbgprint("[%s] ok (chain[%d])\n", dbglog_uid_.c_str(), index);
 
+  record_hop_latency(cur_proxy_ + 1);
+
   ++cur_proxy_;
+  arm_hop_timer();
   connect_next(boost::system::error_code(), index+1);
 }
 
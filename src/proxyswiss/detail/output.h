@@ -2,6 +2,8 @@
 #pragma once
 
 #include "proxyswiss/config.h"
+#include "proxyswiss/detail/happy_eyeballs.h"
+#include "proxyswiss/detail/worker_context.h"
 
 #include "proxy/destination.h"
 #include "proxy/client_session.h"
@@ -9,6 +11,7 @@
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
 
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -20,7 +23,6 @@ public:
   typedef boost::asio::io_context io_context;
   typedef boost::asio::ip::tcp::socket socket;
   typedef boost::asio::ip::tcp::endpoint endpoint;
-  typedef boost::asio::ip::tcp::resolver resolver;
   typedef boost::system::error_code error_code;
 
   struct connect_result {
@@ -42,35 +44,64 @@ public:
 
   typedef std::function<void(const connect_result&)> connect_handler;
 
+  // The chain's client sessions are created in |arena|, which must outlive
+  // output.
   output(io_context& ioc, socket& sock, const config::output_t& cfg_output,
-    const std::string& dbglog_uid);
+    worker_context& ctx, const std::string& dbglog_uid,
+    proxy::session_arena& arena);
 
   // ---
 
+  // With cfg_output.hop_timeout, a hop not connected through in time
+  // fails with boost::asio::error::timed_out. A resolve or a connect in
+  // flight is given up on right away, a pending read or write on the
+  // socket once the closed socket aborts it.
   void connect_through_chain(const proxy::destination& dst,
     connect_handler handler);
 
+  // The chain is connected, drop the protocol state.
+  void free_handshake_state();
+
 private:
-  void create_chain(const std::string&);
+  void create_chain(const std::string&, proxy::session_arena&);
   void call_and_clear_handler(connect_result);
+  void arm_hop_timer();
+  static void handle_hop_deadline(void*);
+  void resolve(const std::string&, uint16_t, size_t);
   void connect_next(error_code, size_t);
+  void connect_first(const dns_cache::address_list&, uint16_t, size_t);
+  void record_hop_latency(size_t);
+  void count_fastopen();
 
-  void handle_resolve(error_code, resolver::iterator, uint16_t, size_t);
+  void handle_resolve(error_code, const dns_cache::address_list&, uint16_t,
+    size_t);
   void handle_connect(error_code, size_t);
   void handle_write_connect_request(error_code, size_t);
   void handle_read_connect_response(error_code, size_t);
 
 private:
+  typedef std::unique_ptr<proxy::client_session,
+    proxy::session_arena::deleter<proxy::client_session>>
+    client_session_uptr;
+  typedef std::vector<client_session_uptr,
+    proxy::session_arena::allocator<client_session_uptr>> chain;
+
   io_context& ioc_;
   std::string                                        dbglog_uid_;
   socket&                                            sock_;
   const config::output_t&                            cfg_output_;
+  worker_context&                                    ctx_;
   connect_handler                                    user_connect_handler_;
   proxy::destination                                 final_dst_;
-  std::vector<std::unique_ptr<proxy::client_session>>  chain_;
-  std::unique_ptr<resolver>                          resolver_uptr_;
+  chain                                              chain_;
   size_t                                             cur_proxy_;
   proxy::connect_response                            conn_resp_;
+  std::chrono::steady_clock::time_point              hop_start_;
+  timer_wheel::timer                                 hop_timer_;
+  bool                                               hop_timed_out_;
+  const std::string*                                 resolve_host_;
+  uint64_t                                           resolve_ticket_;
+  std::weak_ptr<happy_eyeballs>                      connecting_;
 };
 
 }}
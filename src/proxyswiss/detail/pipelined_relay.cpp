@@ -0,0 +1,147 @@
+#include "proxyswiss/detail/pipelined_relay.h"
+
+#include <boost/asio/write.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <assert.h>
+
+#define dbgprint(...) __noop
+
+using namespace std;
+using namespace boost::placeholders;
+
+namespace proxyswiss {
+namespace detail {
+
+// Buffer sequence over the first |n| of an array. async_write() keeps a
+// copy of the sequence, a vector would be copied to the heap every time.
+struct buffer_span {
+  typedef boost::asio::const_buffer value_type;
+  typedef const boost::asio::const_buffer* const_iterator;
+
+  const_iterator b;
+  const_iterator e;
+
+  const_iterator begin() const { return b; }
+  const_iterator end() const { return e; }
+};
+
+pipelined_relay::pipelined_relay(socket& from, socket& to,
+  buffer_pool& pool, padded_counter& bytes, boost::shared_ptr<void> owner,
+  size_t max_in_flight)
+  : relay(from, to, pool, bytes, owner), head_(0), count_(0), writing_(0),
+    in_flight_(0), max_in_flight_(max_in_flight), read_pending_(false),
+    eof_(false), failed_(false)
+{
+  assert(max_in_flight <= config::relay_t::kMaxInFlight);
+}
+
+void pipelined_relay::do_start() {
+  begin_read();
+}
+
+void pipelined_relay::fail() {
+  failed_ = true;
+  close_all();
+}
+
+void pipelined_relay::begin_read() {
+  if (read_pending_ || eof_ || failed_) {
+    return;
+  }
+  // Backpressure
+  if (count_ == kRingSize || in_flight_ >= max_in_flight_) {
+    return;
+  }
+
+  chunk& c(ring_[(head_ + count_) % kRingSize]);
+  c.buf = pool_.acquire(kChunkSizeClass);
+  c.len = 0;
+
+  read_pending_ = true;
+  from_.async_read_some(boost::asio::buffer(c.buf.data(), c.buf.size()),
+    bind(read_mem_,
+      boost::bind(&pipelined_relay::handle_read, this, _1, _2)));
+}
+
+void pipelined_relay::handle_read(error_code err, size_t num_bytes) {
+  read_pending_ = false;
+
+  chunk& c(ring_[(head_ + count_) % kRingSize]);
+
+  if (err) {
+    c.buf.reset();
+
+    if (err == boost::asio::error::eof) {
+      dbgprint("eof\n");
+      eof_ = true;
+      if (count_ == 0) {
+        shutdown_to();
+      }
+      // Otherwise |to_| is shut down when the ring is drained.
+    }
+    else {
+      dbgprint("hard error, closing\n");
+      fail();
+    }
+    return;
+  }
+
+  if (failed_) {
+    c.buf.reset();
+    return;
+  }
+
+  c.len = num_bytes;
+  ++count_;
+  in_flight_ += num_bytes;
+
+  begin_write();
+  begin_read();
+}
+
+void pipelined_relay::begin_write() {
+  if (writing_ || count_ == 0 || failed_) {
+    return;
+  }
+
+  for (size_t i = 0; i < count_; i++) {
+    const chunk& c(ring_[(head_ + i) % kRingSize]);
+    write_bufs_[i] = boost::asio::const_buffer(c.buf.data(), c.len);
+  }
+  writing_ = count_;
+
+  const buffer_span bufs = { write_bufs_, write_bufs_ + count_ };
+  boost::asio::async_write(to_, bufs,
+    bind(write_mem_,
+      boost::bind(&pipelined_relay::handle_write, this, _1, _2)));
+}
+
+void pipelined_relay::handle_write(error_code err, size_t num_bytes) {
+  if (err) {
+    writing_ = 0;
+    fail();
+    return;
+  }
+  count_bytes(num_bytes);
+
+  for (size_t i = 0; i < writing_; i++) {
+    chunk& c(ring_[head_]);
+    in_flight_ -= c.len;
+    c.buf.reset();
+    head_ = (head_ + 1) % kRingSize;
+  }
+  count_ -= writing_;
+  writing_ = 0;
+
+  if (count_) {
+    begin_write();
+  }
+  else if (eof_) {
+    shutdown_to();
+    return;
+  }
+  begin_read();
+}
+
+}}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "proxyswiss/detail/relay.h"
+
+#include <boost/asio/buffer.hpp>
+
+namespace proxyswiss {
+namespace detail {
+
+// Keeps reading while earlier chunks are still being written. Read
+// chunks are queued in a small ring and written out together with one
+// gathered write. Reading pauses when the ring is full or when more than
+// |max_in_flight| bytes are read but not written yet.
+class pipelined_relay: public relay {
+public:
+  pipelined_relay(socket& from, socket& to, buffer_pool& pool,
+    padded_counter& bytes, boost::shared_ptr<void> owner,
+    size_t max_in_flight);
+
+protected:
+  virtual void do_start() override;
+
+private:
+  static const unsigned kChunkSizeClass = 2;
+  // Room for config::relay_t::kMaxInFlight.
+  static const size_t kRingSize = config::relay_t::kMaxInFlight /
+    buffer_pool::class_size(kChunkSizeClass);
+
+  struct chunk {
+    buffer_pool::buffer  buf;
+    size_t               len;
+  };
+
+  void begin_read();
+  void handle_read(error_code, size_t);
+  void begin_write();
+  void handle_write(error_code, size_t);
+  void fail();
+
+private:
+  handler_memory                          read_mem_;
+  handler_memory                          write_mem_;
+  chunk                                   ring_[kRingSize];
+  size_t                                  head_;    //< oldest chunk
+  size_t                                  count_;   //< chunks in the ring
+  size_t                                  writing_; //< chunks being written
+  size_t                                  in_flight_;
+  size_t                                  max_in_flight_;
+  bool                                    read_pending_;
+  bool                                    eof_;
+  bool                                    failed_;
+  boost::asio::const_buffer               write_bufs_[kRingSize];
+};
+
+}}
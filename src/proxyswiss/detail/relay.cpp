@@ -0,0 +1,186 @@
+#include "proxyswiss/detail/relay.h"
+#include "proxyswiss/detail/splice_relay.h"
+#include "proxyswiss/detail/pipelined_relay.h"
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <assert.h>
+
+#define dbgprint(...) __noop
+
+using namespace std;
+using namespace boost::placeholders;
+
+namespace proxyswiss {
+namespace detail {
+
+// Grow the buffer after this many reads in a row filled it.
+static const unsigned kGrowAfter = 2;
+// Shrink it after this many reads in a row used less than a quarter.
+static const unsigned kShrinkAfter = 4;
+
+relay::relay(socket& from, socket& to, buffer_pool& pool,
+  padded_counter& bytes, boost::shared_ptr<void> owner)
+  : from_(from), to_(to), pool_(pool), bytes_(bytes), owner_(owner),
+    idle_timer_(nullptr), pending_(0)
+{
+}
+
+void relay::start() {
+  self_ = shared_from_this();
+  do_start();
+  if (!pending_) {
+    self_.reset();
+  }
+}
+
+void relay::handler_done() {
+  assert(pending_ > 0);
+  if (--pending_ == 0) {
+    // Nothing more is going to happen, this can be the last reference.
+    boost::shared_ptr<relay> self;
+    self.swap(self_);
+  }
+}
+
+void relay::shutdown_to() {
+  error_code ec;
+  to_.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+}
+
+void relay::close_all() {
+  error_code ec;
+  from_.close(ec);
+  to_.close(ec);
+}
+
+// ---
+
+copy_relay::copy_relay(socket& from, socket& to, buffer_pool& pool,
+  padded_counter& bytes, boost::shared_ptr<void> owner, bool park_when_idle)
+  : relay(from, to, pool, bytes, owner), size_class_(0), full_reads_(0),
+    small_reads_(0), park_when_idle_(park_when_idle)
+{
+}
+
+void copy_relay::do_start() {
+  if (park_when_idle_) {
+    begin_wait_readable();
+  }
+  else {
+    begin_read();
+  }
+}
+
+void copy_relay::begin_wait_readable() {
+  buf_.reset();
+
+  from_.async_wait(socket::wait_read,
+    bind(handler_mem_, boost::bind(&copy_relay::handle_readable, this, _1)));
+}
+
+void copy_relay::handle_readable(error_code err) {
+  if (err) {
+    close_all();
+    return;
+  }
+  // The data (or eof) is there, the read completes at once.
+  begin_read();
+}
+
+void copy_relay::begin_read() {
+  if (buf_.empty() || buf_.size_class() != size_class_) {
+    buf_ = pool_.acquire(size_class_);
+  }
+
+  from_.async_read_some(boost::asio::buffer(buf_.data(), buf_.size()),
+    bind(handler_mem_,
+      boost::bind(&copy_relay::handle_read, this, _1, _2)));
+}
+
+void copy_relay::handle_read(error_code err, size_t num_bytes) {
+  if (!err) {
+    adapt_size_class(num_bytes);
+
+    boost::asio::async_write(to_,
+      boost::asio::buffer(buf_.data(), num_bytes),
+      bind(handler_mem_,
+        boost::bind(&copy_relay::handle_write, this, _1, _2)));
+  }
+  else {
+    if (err == boost::asio::error::eof) {
+      dbgprint("eof\n");
+      shutdown_to();
+    }
+    else {
+      dbgprint("hard error, closing\n");
+      close_all();
+    }
+    // Nothing more to read, don't hold the memory until the other
+    // direction is done.
+    buf_.reset();
+  }
+}
+
+void copy_relay::handle_write(error_code err, size_t num_bytes) {
+  if (err) {
+    close_all();
+    buf_.reset();
+    return;
+  }
+  count_bytes(num_bytes);
+  if (park_when_idle_) {
+    begin_wait_readable();
+  }
+  else {
+    begin_read();
+  }
+}
+
+void copy_relay::adapt_size_class(size_t num_bytes) {
+  if (num_bytes == buf_.size()) {
+    small_reads_ = 0;
+    if (++full_reads_ >= kGrowAfter &&
+        size_class_ + 1 < buffer_pool::kNumClasses)
+    {
+      ++size_class_;
+      full_reads_ = 0;
+    }
+  }
+  else if (num_bytes < buf_.size() / 4) {
+    full_reads_ = 0;
+    if (++small_reads_ >= kShrinkAfter && size_class_ > 0) {
+      --size_class_;
+      small_reads_ = 0;
+    }
+  }
+  else {
+    full_reads_ = small_reads_ = 0;
+  }
+}
+
+// ---
+
+relay* create_relay(const config::relay_t& cfg_relay, buffer_pool& pool,
+  relay::socket& from, relay::socket& to, padded_counter& bytes,
+  boost::shared_ptr<void> owner)
+{
+  switch (cfg_relay.mode) {
+#ifdef PROXYSWISS_HAVE_SPLICE
+  case config::eRelaySplice:
+    return new splice_relay(from, to, pool, bytes, owner);
+#endif
+  case config::eRelayPipelined:
+    return new pipelined_relay(from, to, pool, bytes, owner,
+      cfg_relay.max_in_flight);
+  case config::eRelayParked:
+    return new copy_relay(from, to, pool, bytes, owner, true);
+  case config::eRelayCopy:
+  default:
+    return new copy_relay(from, to, pool, bytes, owner);
+  }
+}
+
+}}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "proxyswiss/config.h"
+#include "proxyswiss/detail/buffer_pool.h"
+#include "proxyswiss/detail/counters.h"
+#include "proxyswiss/detail/handler_memory.h"
+#include "proxyswiss/detail/timer_wheel.h"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <utility>
+
+namespace proxyswiss {
+namespace detail {
+
+// Moves data in one direction, from |from| to |to|, until eof or error.
+// On eof |to| is shut down for sending, on error both sockets are closed.
+// Bytes written to |to| are added to |bytes|.
+// A relay keeps itself alive from start() until its last pending handler
+// returns without starting another operation, and keeps |owner| (the
+// object owning the sockets) alive in turn. Handlers made by bind() take
+// their memory from a handler_memory of the relay and hold no reference,
+// so relaying a chunk allocates nothing and touches no reference count.
+// A relay still running when its io_context is destroyed is leaked.
+class relay: public boost::enable_shared_from_this<relay> {
+public:
+  typedef boost::asio::ip::tcp::socket socket;
+  typedef boost::system::error_code error_code;
+
+  virtual ~relay() {}
+
+  // Touched whenever bytes are relayed. Call before start(). |t| belongs
+  // to the owner.
+  void set_idle_timer(timer_wheel::timer* t) { idle_timer_ = t; }
+
+  void start();
+
+protected:
+  template <typename Handler>
+  class bound_handler {
+  public:
+    typedef handler_allocator<char> allocator_type;
+
+    bound_handler(relay* r, handler_memory& mem, Handler h)
+      : relay_(r), memory_(&mem), handler_(std::move(h))
+    {
+    }
+
+    allocator_type get_allocator() const noexcept {
+      return allocator_type(*memory_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+      relay* r = relay_;
+      handler_(std::forward<Args>(args)...);
+      r->handler_done();
+    }
+
+  private:
+    relay*           relay_;
+    handler_memory*  memory_;
+    Handler          handler_;
+  };
+
+  // For an operation about to be started. |h| binds a raw |this|.
+  template <typename Handler>
+  bound_handler<Handler> bind(handler_memory& mem, Handler h) {
+    ++pending_;
+    return bound_handler<Handler>(this, mem, std::move(h));
+  }
+
+  virtual void do_start() = 0;
+
+  // |pool| and |bytes| must outlive |owner|.
+  relay(socket& from, socket& to, buffer_pool& pool, padded_counter& bytes,
+    boost::shared_ptr<void> owner);
+
+  void shutdown_to();
+  void close_all();
+  // After a write to |to|.
+  void count_bytes(size_t n) {
+    bytes_.add(n);
+    if (idle_timer_) {
+      idle_timer_->touch();
+    }
+  }
+
+private:
+  void handler_done();
+
+protected:
+  socket&                  from_;
+  socket&                  to_;
+  buffer_pool&             pool_;
+  padded_counter&          bytes_;
+  boost::shared_ptr<void>  owner_;
+  timer_wheel::timer*      idle_timer_;
+
+private:
+  boost::shared_ptr<relay>  self_;     //< while operations are pending
+  unsigned                  pending_;
+};
+
+// The plain read_some/write loop. Works everywhere.
+// The buffer comes from the pool and follows the traffic: it grows after
+// a few reads in a row fill it and shrinks after a few small reads.
+// If |park_when_idle|, the buffer goes back to the pool after each write
+// and the relay waits for readability before borrowing it again, so an
+// idle tunnel holds no buffer at all.
+class copy_relay: public relay {
+public:
+  copy_relay(socket& from, socket& to, buffer_pool& pool,
+    padded_counter& bytes, boost::shared_ptr<void> owner,
+    bool park_when_idle = false);
+
+protected:
+  virtual void do_start() override;
+
+private:
+  void begin_read();
+  void begin_wait_readable();
+  void handle_readable(error_code);
+  void handle_read(error_code, size_t);
+  void handle_write(error_code, size_t);
+  void adapt_size_class(size_t);
+
+private:
+  handler_memory       handler_mem_;
+  buffer_pool::buffer  buf_;
+  unsigned             size_class_;
+  unsigned             full_reads_;
+  unsigned             small_reads_;
+  bool                 park_when_idle_;
+};
+
+relay* create_relay(const config::relay_t& cfg_relay, buffer_pool& pool,
+  relay::socket& from, relay::socket& to, padded_counter& bytes,
+  boost::shared_ptr<void> owner);
+
+}}
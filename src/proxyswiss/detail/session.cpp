@@ -1,5 +1,7 @@
 
 #include "proxyswiss/detail/session.h"
+#include "proxyswiss/detail/relay.h"
+#include "proxyswiss/detail/socket_tuning.h"
 #include "proxy/error.h"
 
 #include "common/base/str.h"
@@ -8,6 +10,8 @@
 
 #include <iostream>
 
+#include <assert.h>
+
 #define dbgprint(...) __noop
 
 using namespace std;
@@ -16,65 +20,108 @@ using namespace boost::placeholders;
 namespace proxyswiss {
 namespace detail {
 
-static const size_t kReadBufSize = 4096;
-
-session::session(io_context& ioc, const config& cfg
-#ifdef _DEBUG
-  , detail::debug_uid_table& dbg_uid_table
-#endif
-  )
+session::session(io_context& ioc, const config& cfg,
+  std::shared_ptr<worker_context> ctx)
   :
-#ifdef _DEBUG
-  dbg_uid_(dbg_uid_table),
-  dbg_uid_str_(dbg_uid_.to_string()),
-#endif
   //ioc_(ioc),
   cfg_(cfg),
+  ctx_(ctx),
+  id_(*ctx->session_ids_sptr),
+  id_str_(id_.to_string()),
   input_sock_(ioc),
   output_sock_(ioc),
-  input_(input_sock_, cfg.input, dbg_uid_str_),
-  output_(ioc, output_sock_, cfg.output, dbg_uid_str_),
+  arena_(arena_mem_, sizeof(arena_mem_)),
+  input_(input_sock_, cfg.input, id_str_, arena_),
+  output_(ioc, output_sock_, cfg.output, *ctx, id_str_, arena_),
+  deadline_(&session::handle_deadline, this),
   print_proxy_errors_(false),
-  plogfile_(nullptr)
+  pconnect_log_(nullptr),
+  active_(false)
 {
 }
 
 session::~session() {
-  dbgprint("[%s] session closed\n", dbg_uid_str_.c_str());
+  dbgprint("[%s] session closed\n", id_str_.c_str());
+
+  if (active_) {
+    --ctx_->active_sessions;
+  }
+  if (tunnel_start_ != chrono::steady_clock::time_point()) {
+    ctx_->latency_uptr->tunnel_lifetime.record(
+      chrono::steady_clock::now() - tunnel_start_);
+  }
 }
 
 void session::enable_print_proxy_errors(bool enable) {
   print_proxy_errors_ = enable;
 }
 
-void session::set_log_file(std::ofstream&   logfile,
-                           set<string>&     history)
-{
-  plogfile_ = &logfile;
-  phistory_ = &history;
+void session::set_connect_log(connect_log& log) {
+  pconnect_log_ = &log;
+}
+
+void session::set_active() {
+  assert(!active_);
+
+  active_ = true;
+  ++ctx_->active_sessions;
 }
 
 void session::start() {
+  stage_start_ = chrono::steady_clock::now();
+
+  tune_connected(input_sock_, cfg_.input.sock_profile);
+  if (cfg_.input.sock_profile.fastopen && syn_data_acked(input_sock_)) {
+    ctx_->counters.fastopen_in_acked.add(1);
+  }
+
+  if (cfg_.input.handshake_timeout) {
+    ctx_->wheel_uptr->arm(deadline_,
+      chrono::seconds(cfg_.input.handshake_timeout));
+  }
+
   input_.read_connect_request(dst_,
     boost::bind(&session::handle_read_connect_request, shared_from_this(),
       _1));
 }
 
+void session::handle_deadline(void* arg) {
+  session* self = static_cast<session*>(arg);
+
+  if (self->tunnel_start_ == chrono::steady_clock::time_point()) {
+    dbgprint("[%s] handshake timed out\n", self->id_str_.c_str());
+    self->ctx_->counters.handshake_timeouts.add(1);
+  }
+  else {
+    dbgprint("[%s] {%s} idle timeout\n", self->id_str_.c_str(),
+      self->dst_.to_string().c_str());
+    self->ctx_->counters.idle_timeouts.add(1);
+  }
+  // The pending operations fail and the session goes away with the last
+  // of them.
+  self->close_all();
+}
+
 void session::close_all() {
   input_sock_.close();
   output_sock_.close();
 }
 
 void session::handle_read_connect_request(error_code err) {
+  ctx_->wheel_uptr->cancel(deadline_);
+
   if (err) {
-    dbgprint("[%s] error %s.%d\n", dbg_uid_str_.c_str(),
+    dbgprint("[%s] error %s.%d\n", id_str_.c_str(),
       err.category().name(), err.value());
 
     close_all();
     return;
   }
 
-  dbgprint("[%s] connecting through chain to {%s}\n", dbg_uid_str_.c_str(),
+  ctx_->latency_uptr->handshake_read.record(
+    chrono::steady_clock::now() - stage_start_);
+
+  dbgprint("[%s] connecting through chain to {%s}\n", id_str_.c_str(),
     dst_.to_string().c_str());
 
   output_.connect_through_chain(dst_,
@@ -84,22 +131,19 @@ void session::handle_read_connect_request(error_code err) {
 void session::handle_connect_output(const output::connect_result& conn_res)
 {
   output_conn_res_ = conn_res;
+  stage_start_ = chrono::steady_clock::now();
+  count_connect_result(conn_res);
 
   proxy::connect_response prx_resp;
   if (conn_res.success) {
 
-    string id_str;
-    id_str = dst_.using_hostname() ? dst_.hostname : dst_.ip_address.to_string();
-    id_str += ":" + common::str_from_uint(dst_.port);
+    if (pconnect_log_) {
+      string id_str;
+      id_str = dst_.using_hostname() ?
+        dst_.hostname : dst_.ip_address.to_string();
+      id_str += ":" + common::str_from_uint(dst_.port);
 
-    if (phistory_->end() ==
-        std::find(phistory_->begin(), phistory_->end(),
-                  id_str))
-    {
-      if (plogfile_) {
-        (*plogfile_) << id_str << endl;
-      }
-      phistory_->insert(id_str);
+      pconnect_log_->add(id_str);
     }
 
     prx_resp.major = proxy::connect_response::eSucceeded;
@@ -129,7 +173,8 @@ void session::handle_connect_output(const output::connect_result& conn_res)
             fail_proxy_address = "?";
           }
 
-          cout << "[PROXY ERROR] " << fail_proxy_address << ": " <<
+          cout << "[PROXY ERROR] [" << id_str_ << "] " <<
+            fail_proxy_address << ": " <<
             conn_res.err.message() << "\n";
         }
       }
@@ -147,7 +192,7 @@ void session::handle_connect_output(const output::connect_result& conn_res)
   }
 
   dbgprint("[%s] {%s} connect_result: %s\n",
-    dbg_uid_str_.c_str(), dst_.to_string().c_str(),
+    id_str_.c_str(), dst_.to_string().c_str(),
     conn_res.to_string().c_str());
 
   input_.write_connect_response(prx_resp,
@@ -155,115 +200,104 @@ void session::handle_connect_output(const output::connect_result& conn_res)
       shared_from_this(), _1));
 }
 
+void session::count_connect_result(const output::connect_result& conn_res)
+{
+  // Every hop before the failing one was passed.
+  worker_counters& c(ctx_->counters);
+  size_t passed = c.num_hops;
+  if (!conn_res.success) {
+    passed = conn_res.chain_fail_index == output::connect_result::kNoIndex ?
+      0 : conn_res.chain_fail_index;
+    if (passed < c.num_hops) {
+      c.hops[passed].failed.add(1);
+    }
+  }
+  for (size_t i = 0; i < passed && i < c.num_hops; i++) {
+    c.hops[i].succeeded.add(1);
+  }
+}
+
 void session::handle_write_connect_response(error_code err) {
   if (err) {
-    dbgprint("[%s] {%s} error %s.%d\n", dbg_uid_str_.c_str(),
+    dbgprint("[%s] {%s} error %s.%d\n", id_str_.c_str(),
       dst_.to_string().c_str(), err.category().name(), err.value());
 
     close_all();
     return;
   }
 
+  ctx_->latency_uptr->response_write.record(
+    chrono::steady_clock::now() - stage_start_);
+
   if (!output_conn_res_.success) {
     dbgprint("[%s] {%s} closing because !conn_res_.success\n",
-      dbg_uid_str_.c_str(), dst_.to_string().c_str());
+      id_str_.c_str(), dst_.to_string().c_str());
 
     close_all();
     return;
   }
 
-  dbgprint("[%s] {%s} OK, making tunnel ...\n", dbg_uid_str_.c_str(),
+  // The client may have sent data right behind the request.
+  input_.take_unread_data(client_data_);
+  if (!client_data_.empty()) {
+    boost::asio::async_write(output_sock_,
+      boost::asio::buffer(client_data_),
+      boost::bind(&session::handle_write_client_data, shared_from_this(),
+        _1, _2));
+    return;
+  }
+
+  dbgprint("[%s] {%s} OK, making tunnel ...\n", id_str_.c_str(),
     dst_.to_string().c_str());
 
   make_tunnel();
 }
 
-void session::alloc_read_buffers() {
-  input_read_buf_uptr_.reset(new vector<char>(kReadBufSize));
-  output_read_buf_uptr_.reset(new vector<char>(kReadBufSize));
-}
+void session::handle_write_client_data(error_code err, size_t) {
+  std::string().swap(client_data_);
 
-void session::make_tunnel() {
-  alloc_read_buffers();
+  if (err) {
+    close_all();
+    return;
+  }
 
-  begin_input_read();
-  begin_output_read();
+  make_tunnel();
 }
 
-void session::begin_input_read() {
-  input_sock_.async_read_some(boost::asio::buffer(*input_read_buf_uptr_),
-    boost::bind(&session::handle_input_read, shared_from_this(), _1, _2));
-}
+void session::make_tunnel() {
+  // We can be deep inside a handler chain of the protocol objects here,
+  // free them later.
+  boost::asio::post(input_sock_.get_executor(),
+    boost::bind(&session::free_handshake_state, shared_from_this()));
 
-void session::begin_output_read() {
-  output_sock_.async_read_some(boost::asio::buffer(*output_read_buf_uptr_),
-    boost::bind(&session::handle_output_read, shared_from_this(), _1, _2));
-}
+  tunnel_start_ = chrono::steady_clock::now();
 
-void session::handle_input_read(error_code err, size_t num_bytes) {
-  if (!err) {
-    begin_output_write(num_bytes);
+  if (cfg_.relay.idle_timeout) {
+    ctx_->wheel_uptr->arm(deadline_,
+      chrono::seconds(cfg_.relay.idle_timeout), true);
   }
-  else {
-    if (err == boost::asio::error::eof) {
-      dbgprint("eof\n");
 
-      error_code ec;
-      output_sock_.shutdown(boost::asio::ip::tcp::socket::shutdown_send,
-                            ec);
-    }
-    else {
-      dbgprint("hard error, closing\n");
-      close_all();
-    }
-  }
-}
+  tune_tunnel(input_sock_, cfg_.input.sock_profile);
+  tune_tunnel(output_sock_, cfg_.output.sock_profile);
 
-void session::handle_output_read(error_code err, size_t num_bytes) {
-  if (!err) {
-    begin_input_write(num_bytes);
-  }
-  else {
-    if (err == boost::asio::error::eof) {
-      dbgprint("eof\n");
-
-      error_code ec;
-      input_sock_.shutdown(boost::asio::ip::tcp::socket::shutdown_send,
-                           ec);
-    }
-    else {
-      dbgprint("hard error, closing\n");
-      close_all();
-    }
-  }
-}
-
-void session::begin_input_write(size_t num_bytes) {
-  boost::asio::async_write(input_sock_,
-    boost::asio::buffer(*output_read_buf_uptr_, num_bytes),
-    boost::bind(&session::handle_input_write, shared_from_this(), _1, _2));
+  start_relay(input_sock_, output_sock_, ctx_->counters.bytes_upstream);
+  start_relay(output_sock_, input_sock_, ctx_->counters.bytes_downstream);
 }
 
-void session::begin_output_write(size_t num_bytes) {
-  boost::asio::async_write(output_sock_,
-    boost::asio::buffer(*input_read_buf_uptr_, num_bytes),
-    boost::bind(&session::handle_output_write, shared_from_this(), _1, _2));
+void session::free_handshake_state() {
+  input_.free_handshake_state();
+  output_.free_handshake_state();
 }
 
-void session::handle_input_write(error_code err, size_t) {
-  if (err) {
-    close_all();
-    return;
-  }
-  begin_output_read();
-}
+void session::start_relay(socket& from, socket& to, padded_counter& bytes)
+{
+  boost::shared_ptr<relay> r(create_relay(cfg_.relay, ctx_->buf_pool,
+    from, to, bytes, shared_from_this()));
 
-void session::handle_output_write(error_code err, size_t) {
-  if (err) {
-    close_all();
-    return;
+  if (deadline_.armed()) {
+    r->set_idle_timer(&deadline_);
   }
-  begin_input_read();
+  r->start();
 }
 
 }}
@@ -1,22 +1,21 @@
 
 #pragma once
 
+#include "proxyswiss/detail/connect_log.h"
 #include "proxyswiss/detail/input.h"
 #include "proxyswiss/detail/output.h"
-
-#ifdef _DEBUG
-#include "proxyswiss/detail/debug_uid.h"
-#endif
+#include "proxyswiss/detail/session_id_table.h"
+#include "proxyswiss/detail/worker_context.h"
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <vector>
-#include <fstream>
-#include <set>
 
 namespace proxyswiss {
 namespace detail {
@@ -28,58 +27,65 @@ public:
   typedef boost::system::error_code error_code;
   typedef boost::asio::ip::tcp::endpoint endpoint;
 
-  session(io_context& ios, const config& cfg
-#ifdef _DEBUG
-    , detail::debug_uid_table& dbg_uid_table
-#endif
-    );
+  // The id comes from ctx->session_ids_sptr.
+  session(io_context& ios, const config& cfg,
+    std::shared_ptr<worker_context> ctx);
   ~session();
 
   socket& sock() { return input_sock_; }
 
   void enable_print_proxy_errors(bool enable);
-  void set_log_file(std::ofstream& logfile,
-                    std::set<std::string>& history);
+  // Successful connects are added to |log|, which must outlive the
+  // session.
+  void set_connect_log(connect_log& log);
+
+  // Counts the session in worker_context::active_sessions until it is
+  // destroyed.
+  void set_active();
 
   void start();
 
 private:
-  void alloc_read_buffers();
+  // A server session, the chain vector and three hops on 64-bit builds.
+  static const size_t kArenaSize = 1536;
+
+  static void handle_deadline(void*);
   void close_all();
   void make_tunnel();
+  void free_handshake_state();
+  void start_relay(socket& from, socket& to, padded_counter& bytes);
   void handle_read_connect_request(error_code);
   void handle_connect_output(const output::connect_result&);
+  void count_connect_result(const output::connect_result&);
   void handle_write_connect_response(error_code);
-
-  void begin_input_read();
-  void begin_output_read();
-  void handle_input_read(error_code, size_t);
-  void handle_output_read(error_code, size_t);
-
-  void begin_input_write(size_t);
-  void begin_output_write(size_t);
-  void handle_input_write(error_code, size_t);
-  void handle_output_write(error_code, size_t);
-
-private:
-#ifdef _DEBUG
-  detail::debug_uid dbg_uid_;
-#endif
-  std::string dbg_uid_str_;
+  void handle_write_client_data(error_code, size_t);
 
 private:
   const config&                       cfg_;
+  std::shared_ptr<worker_context>     ctx_;
+  session_id                          id_;
+  std::string                         id_str_;  //< for the logs
   socket                              input_sock_;
   socket                              output_sock_;
+  // The handshake objects of input_ and output_ live here, so they come
+  // with the session's own (pooled) block. Chains too long for it spill to
+  // the heap.
+  alignas(std::max_align_t) char      arena_mem_[kArenaSize];
+  proxy::session_arena                arena_;
   input                               input_;
   output                              output_;
+  // The handshake deadline until the request is read, the idle one once
+  // the tunnel is up.
+  timer_wheel::timer                  deadline_;
   proxy::destination                  dst_;
   output::connect_result              output_conn_res_;
-  std::unique_ptr<std::vector<char>>  input_read_buf_uptr_;
-  std::unique_ptr<std::vector<char>>  output_read_buf_uptr_;
+  std::string                         client_data_;
   bool                                print_proxy_errors_;
-  std::ofstream*                      plogfile_;
-  std::set<std::string>*              phistory_;
+  connect_log*                        pconnect_log_;
+  bool                                active_;
+  // For ctx_->latency_uptr
+  std::chrono::steady_clock::time_point  stage_start_;
+  std::chrono::steady_clock::time_point  tunnel_start_;
 };
 
 }}
@@ -0,0 +1,112 @@
+#include "proxyswiss/detail/session_id_table.h"
+
+#include "common/base/str.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <assert.h>
+
+using namespace std;
+
+namespace proxyswiss {
+namespace detail {
+
+static const uint64_t kFull = ~static_cast<uint64_t>(0);
+
+// Index of the lowest clear bit, |w| must have one.
+static unsigned lowest_clear(uint64_t w) {
+  assert(w != kFull);
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, ~w);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctzll(~w));
+#endif
+}
+
+session_id_table::session_id_table(size_t capacity)
+  : capacity_((capacity + 63) / 64 * 64), in_use_(0)
+{
+  if (capacity_ > kNoId) {
+    capacity_ = static_cast<size_t>(kNoId) / 64 * 64;
+  }
+
+  size_t bits = capacity_;
+  for (unsigned level = 0; level < kLevels; level++) {
+    const size_t words = (bits + 63) / 64;
+    levels_[level].assign(words, 0);
+    // Bits past the end stand for words that don't exist, keep them away
+    // from alloc() by making them look full.
+    if (bits % 64) {
+      levels_[level].back() = kFull << (bits % 64);
+    }
+    bits = words;
+  }
+}
+
+uint32_t session_id_table::alloc() {
+  lock_guard<mutex> lock(mutex_);
+
+  // The top level is short, a few words for a million ids.
+  const vector<uint64_t>& top(levels_[kLevels - 1]);
+  size_t index = 0;
+  while (index < top.size() && top[index] == kFull) {
+    index++;
+  }
+  if (index == top.size()) {
+    return kNoId;
+  }
+  for (unsigned level = kLevels; level-- > 0; ) {
+    index = index * 64 + lowest_clear(levels_[level][index]);
+  }
+  // |index| is the id now, set its bit and mark the words it filled up.
+  const uint32_t id = static_cast<uint32_t>(index);
+  for (unsigned level = 0; level < kLevels; level++) {
+    uint64_t& w(levels_[level][index / 64]);
+    w |= static_cast<uint64_t>(1) << (index % 64);
+    if (w != kFull) {
+      break;
+    }
+    index /= 64;
+  }
+  in_use_++;
+  return id;
+}
+
+void session_id_table::free(uint32_t id) {
+  lock_guard<mutex> lock(mutex_);
+
+  assert(id < capacity_);
+  assert(levels_[0][id / 64] & (static_cast<uint64_t>(1) << (id % 64)));
+
+  size_t index = id;
+  for (unsigned level = 0; level < kLevels; level++) {
+    uint64_t& w(levels_[level][index / 64]);
+    const bool was_full = w == kFull;
+    w &= ~(static_cast<uint64_t>(1) << (index % 64));
+    if (!was_full) {
+      break;
+    }
+    index /= 64;
+  }
+  in_use_--;
+}
+
+size_t session_id_table::in_use() const {
+  lock_guard<mutex> lock(mutex_);
+  return in_use_;
+}
+
+// ---
+
+string session_id::to_string() const {
+  if (value_ == session_id_table::kNoId) {
+    return "?";
+  }
+  return common::str_from_uint(value_);
+}
+
+}}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace proxyswiss {
+namespace detail {
+
+// Numbers the sessions of the process, handing out the lowest free id, so
+// ids stay small and are reused. Three levels of bitmaps: a bit per id,
+// then a bit per full word of the level below, so alloc() and free() touch
+// one word per level. A session is created by the accepting worker and
+// freed by the one running it, so the table is locked.
+class session_id_table {
+public:
+  static const uint32_t kNoId = 0xffffffff;
+  static const size_t kDefaultCapacity = 1 << 20;
+
+  // |capacity| is rounded up to a multiple of 64.
+  explicit session_id_table(size_t capacity = kDefaultCapacity);
+
+  // kNoId if all ids are taken.
+  uint32_t alloc();
+  void free(uint32_t id);
+
+  size_t in_use() const;
+
+private:
+  static const unsigned kLevels = 3;
+
+  session_id_table(const session_id_table&) = delete;
+  session_id_table& operator=(const session_id_table&) = delete;
+
+private:
+  mutable std::mutex     mutex_;
+  // [0] has a bit per id, [1] a bit per full word of [0], [2] a bit per
+  // full word of [1].
+  std::vector<uint64_t>  levels_[kLevels];
+  size_t                 capacity_;
+  size_t                 in_use_;
+};
+
+// A session's id, given back when the session goes away. |table| must
+// outlive it.
+class session_id {
+public:
+  explicit session_id(session_id_table& table)
+    : table_(table), value_(table.alloc())
+  {
+  }
+
+  ~session_id() {
+    if (value_ != session_id_table::kNoId) {
+      table_.free(value_);
+    }
+  }
+
+  uint32_t value() const { return value_; }
+
+  // "?" if the table was full.
+  std::string to_string() const;
+
+private:
+  session_id(const session_id&) = delete;
+  session_id& operator=(const session_id&) = delete;
+
+private:
+  session_id_table&  table_;
+  uint32_t           value_;
+};
+
+}}
@@ -0,0 +1,66 @@
+#include "proxyswiss/detail/session_pool.h"
+
+#include <new>
+
+using namespace std;
+
+namespace proxyswiss {
+namespace detail {
+
+session_pool::stats& session_pool::stats::operator+=(const stats& other) {
+  hits += other.hits;
+  misses += other.misses;
+  cached += other.cached;
+  return *this;
+}
+
+// ---
+
+session_pool::session_pool(size_t max_cached)
+  : block_size_(0), max_cached_(max_cached), hits_(0), misses_(0)
+{
+  free_list_.reserve(max_cached_);
+}
+
+session_pool::~session_pool() {
+  for (size_t i = 0; i < free_list_.size(); i++) {
+    ::operator delete(free_list_[i]);
+  }
+}
+
+void* session_pool::allocate(size_t size) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (block_size_ == 0) {
+      block_size_ = size;
+    }
+    if (size == block_size_ && !free_list_.empty()) {
+      void* p = free_list_.back();
+      free_list_.pop_back();
+      hits_.fetch_add(1, memory_order_relaxed);
+      return p;
+    }
+  }
+  misses_.fetch_add(1, memory_order_relaxed);
+  return ::operator new(size);
+}
+
+void session_pool::deallocate(void* p, size_t size) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (size == block_size_ && free_list_.size() < max_cached_) {
+      free_list_.push_back(p);
+      return;
+    }
+  }
+  ::operator delete(p);
+}
+
+void session_pool::get_stats(stats& st) const {
+  st.hits = hits_.load(memory_order_relaxed);
+  st.misses = misses_.load(memory_order_relaxed);
+  lock_guard<mutex> lock(mutex_);
+  st.cached = free_list_.size();
+}
+
+}}
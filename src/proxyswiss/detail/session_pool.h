@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace proxyswiss {
+namespace detail {
+
+// Recycled memory for the sessions of one worker, handed out through
+// session_allocator by allocate_shared, so one block holds the session and
+// its shared_ptr control block. A session is created by the accepting
+// worker and freed by the one running it, which differ unless every worker
+// has its own acceptor, so the free list is locked; the lock is taken once
+// per accept and once per closed session.
+class session_pool {
+public:
+  static const size_t kDefaultMaxCached = 1024;
+
+  struct stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t cached;
+
+    stats(): hits(0), misses(0), cached(0)
+    {
+    }
+
+    stats& operator+=(const stats& other);
+  };
+
+  explicit session_pool(size_t max_cached = kDefaultMaxCached);
+  ~session_pool();
+
+  // Blocks of any other size than the first one asked for bypass the
+  // pool.
+  void* allocate(size_t size);
+  void deallocate(void* p, size_t size);
+
+  void get_stats(stats& st) const;
+
+private:
+  session_pool(const session_pool&) = delete;
+  session_pool& operator=(const session_pool&) = delete;
+
+private:
+  mutable std::mutex  mutex_;
+  std::vector<void*>  free_list_;
+  size_t              block_size_;
+  size_t              max_cached_;
+
+  std::atomic<uint64_t>  hits_;
+  std::atomic<uint64_t>  misses_;
+};
+
+// Keeps the pool alive until the last session allocated from it is freed,
+// which may be after the worker is gone.
+template <typename T>
+class session_allocator {
+public:
+  typedef T value_type;
+
+  explicit session_allocator(std::shared_ptr<session_pool> pool)
+    : pool_(std::move(pool))
+  {
+  }
+
+  template <typename U>
+  session_allocator(const session_allocator<U>& other) noexcept
+    : pool_(other.pool_)
+  {
+  }
+
+  bool operator==(const session_allocator& other) const noexcept {
+    return pool_ == other.pool_;
+  }
+
+  bool operator!=(const session_allocator& other) const noexcept {
+    return pool_ != other.pool_;
+  }
+
+  T* allocate(size_t n) const {
+    return static_cast<T*>(pool_->allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T* p, size_t n) const {
+    pool_->deallocate(p, sizeof(T) * n);
+  }
+
+private:
+  template <typename> friend class session_allocator;
+
+  std::shared_ptr<session_pool>  pool_;
+};
+
+}}
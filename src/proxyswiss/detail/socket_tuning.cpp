@@ -0,0 +1,274 @@
+#include "proxyswiss/detail/socket_tuning.h"
+
+#include <boost/asio/socket_base.hpp>
+
+using namespace std;
+using boost::asio::ip::tcp;
+using boost::asio::socket_base;
+
+namespace proxyswiss {
+namespace detail {
+
+using boost::system::error_code;
+
+#if defined(TCP_NOTSENT_LOWAT)
+typedef boost::asio::detail::socket_option::integer<
+  IPPROTO_TCP, TCP_NOTSENT_LOWAT> notsent_lowat_option;
+static const bool kHaveNotsentLowat = true;
+#else
+static const bool kHaveNotsentLowat = false;
+#endif
+
+#if defined(TCP_QUICKACK)
+typedef boost::asio::detail::socket_option::boolean<
+  IPPROTO_TCP, TCP_QUICKACK> quickack_option;
+static const bool kHaveQuickack = true;
+#else
+static const bool kHaveQuickack = false;
+#endif
+
+#if defined(TCP_DEFER_ACCEPT)
+typedef boost::asio::detail::socket_option::integer<
+  IPPROTO_TCP, TCP_DEFER_ACCEPT> defer_accept_option;
+static const bool kHaveDeferAccept = true;
+#else
+static const bool kHaveDeferAccept = false;
+#endif
+
+#if defined(TCP_FASTOPEN)
+typedef boost::asio::detail::socket_option::integer<
+  IPPROTO_TCP, TCP_FASTOPEN> fastopen_option;
+static const bool kHaveFastopen = true;
+#else
+static const bool kHaveFastopen = false;
+#endif
+
+#if defined(TCP_FASTOPEN_CONNECT)
+typedef boost::asio::detail::socket_option::boolean<
+  IPPROTO_TCP, TCP_FASTOPEN_CONNECT> fastopen_connect_option;
+#endif
+
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+typedef boost::asio::detail::socket_option::integer<
+  IPPROTO_TCP, TCP_KEEPIDLE> keepalive_idle_option;
+typedef boost::asio::detail::socket_option::integer<
+  IPPROTO_TCP, TCP_KEEPINTVL> keepalive_interval_option;
+typedef boost::asio::detail::socket_option::integer<
+  IPPROTO_TCP, TCP_KEEPCNT> keepalive_count_option;
+static const bool kHaveKeepaliveTimes = true;
+#else
+static const bool kHaveKeepaliveTimes = false;
+#endif
+
+template <typename Socket>
+static void set_buffer_sizes(Socket& s, const config::socket_profile& prof,
+  error_code& rcvbuf_err, error_code& sndbuf_err)
+{
+  if (prof.rcvbuf) {
+    s.set_option(socket_base::receive_buffer_size(
+      static_cast<int>(prof.rcvbuf)), rcvbuf_err);
+  }
+  if (prof.sndbuf) {
+    s.set_option(socket_base::send_buffer_size(
+      static_cast<int>(prof.sndbuf)), sndbuf_err);
+  }
+}
+
+static void add_failed(string& failed, const char* name,
+  const error_code& err)
+{
+  if (!failed.empty()) {
+    failed += ", ";
+  }
+  failed += name;
+  failed += " (" + err.message() + ")";
+}
+
+bool tune_listener(tcp::acceptor& acpt, const config::socket_profile& prof,
+  string& failed)
+{
+  failed.clear();
+
+  error_code rcvbuf_err, sndbuf_err;
+  set_buffer_sizes(acpt, prof, rcvbuf_err, sndbuf_err);
+  if (rcvbuf_err) {
+    add_failed(failed, "SO_RCVBUF", rcvbuf_err);
+  }
+  if (sndbuf_err) {
+    add_failed(failed, "SO_SNDBUF", sndbuf_err);
+  }
+
+#if defined(TCP_DEFER_ACCEPT)
+  if (prof.defer_accept) {
+    error_code err;
+    acpt.set_option(defer_accept_option(
+      static_cast<int>(prof.defer_accept)), err);
+    if (err) {
+      add_failed(failed, "TCP_DEFER_ACCEPT", err);
+    }
+  }
+#endif
+#if defined(TCP_FASTOPEN)
+  if (prof.fastopen) {
+    error_code err;
+    acpt.set_option(fastopen_option(static_cast<int>(prof.fastopen)), err);
+    if (err) {
+      add_failed(failed, "TCP_FASTOPEN", err);
+    }
+  }
+#endif
+  return failed.empty();
+}
+
+void tune_unconnected(tcp::socket& sock, const config::socket_profile& prof,
+  bool fastopen)
+{
+  error_code rcvbuf_err, sndbuf_err;
+  set_buffer_sizes(sock, prof, rcvbuf_err, sndbuf_err);
+#if defined(TCP_FASTOPEN_CONNECT)
+  if (fastopen && prof.fastopen) {
+    error_code ec;
+    sock.set_option(fastopen_connect_option(true), ec);
+  }
+#endif
+}
+
+void tune_connected(tcp::socket& sock, const config::socket_profile& prof)
+{
+  error_code ec;
+  if (prof.nodelay != config::socket_profile::eNodelayDefault) {
+    sock.set_option(tcp::no_delay(true), ec);
+  }
+#if defined(TCP_NOTSENT_LOWAT)
+  if (prof.notsent_lowat) {
+    sock.set_option(notsent_lowat_option(
+      static_cast<int>(prof.notsent_lowat)), ec);
+  }
+#endif
+#if defined(TCP_QUICKACK)
+  if (prof.quickack) {
+    sock.set_option(quickack_option(true), ec);
+  }
+#endif
+  if (prof.keepalive_idle) {
+    sock.set_option(socket_base::keep_alive(true), ec);
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    sock.set_option(keepalive_idle_option(
+      static_cast<int>(prof.keepalive_idle)), ec);
+    if (prof.keepalive_interval) {
+      sock.set_option(keepalive_interval_option(
+        static_cast<int>(prof.keepalive_interval)), ec);
+    }
+    if (prof.keepalive_count) {
+      sock.set_option(keepalive_count_option(
+        static_cast<int>(prof.keepalive_count)), ec);
+    }
+#endif
+  }
+}
+
+void tune_tunnel(tcp::socket& sock, const config::socket_profile& prof) {
+  error_code ec;
+  if (prof.nodelay == config::socket_profile::eNodelayHandshake) {
+    sock.set_option(tcp::no_delay(false), ec);
+  }
+#if defined(TCP_QUICKACK)
+  // Linux drops back to delayed acks on its own, set it again.
+  if (prof.quickack) {
+    sock.set_option(quickack_option(true), ec);
+  }
+#endif
+}
+
+bool fastopen_connect_enabled(const tcp::socket& sock) {
+#if defined(TCP_FASTOPEN_CONNECT)
+  error_code ec;
+  fastopen_connect_option opt;
+  sock.get_option(opt, ec);
+  return !ec && opt.value();
+#else
+  return false;
+#endif
+}
+
+bool syn_data_acked(const tcp::socket& sock) {
+#if defined(TCP_INFO) && defined(TCPI_OPT_SYN_DATA)
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+  if (::getsockopt(const_cast<tcp::socket&>(sock).native_handle(),
+    IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+  {
+    return false;
+  }
+  return (info.tcpi_options & TCPI_OPT_SYN_DATA) != 0;
+#else
+  return false;
+#endif
+}
+
+static void print_na(bool have, wostream& o) {
+  if (!have) {
+    o << L" (n/a)";
+  }
+}
+
+void print_socket_profile(const config::socket_profile& prof, wostream& o)
+{
+  o << prof.name << L":";
+  bool any = false;
+  if (prof.nodelay != config::socket_profile::eNodelayDefault) {
+    o << L" nodelay" <<
+      (prof.nodelay == config::socket_profile::eNodelayHandshake ?
+        L" during handshake" : L"");
+    any = true;
+  }
+  if (prof.rcvbuf) {
+    o << (any ? L"," : L"") << L" rcvbuf " << prof.rcvbuf;
+    any = true;
+  }
+  if (prof.sndbuf) {
+    o << (any ? L"," : L"") << L" sndbuf " << prof.sndbuf;
+    any = true;
+  }
+  if (prof.notsent_lowat) {
+    o << (any ? L"," : L"") << L" notsent-lowat " << prof.notsent_lowat;
+    print_na(kHaveNotsentLowat, o);
+    any = true;
+  }
+  if (prof.quickack) {
+    o << (any ? L"," : L"") << L" quickack";
+    print_na(kHaveQuickack, o);
+    any = true;
+  }
+  if (prof.keepalive_idle) {
+    o << (any ? L"," : L"") << L" keepalive " << prof.keepalive_idle <<
+      L"/" << prof.keepalive_interval << L"/" << prof.keepalive_count;
+    print_na(kHaveKeepaliveTimes, o);
+    any = true;
+  }
+  if (prof.defer_accept) {
+    o << (any ? L"," : L"") << L" defer-accept " << prof.defer_accept <<
+      L" s";
+    print_na(kHaveDeferAccept, o);
+    any = true;
+  }
+  if (prof.fastopen) {
+    o << (any ? L"," : L"") << L" fastopen " << prof.fastopen;
+    print_na(kHaveFastopen, o);
+    any = true;
+  }
+  if (!any) {
+    o << L" OS defaults";
+  }
+}
+
+void print_buffer_sizes(const tcp::acceptor& acpt, ostream& o) {
+  error_code ec;
+  socket_base::receive_buffer_size rcvbuf;
+  socket_base::send_buffer_size sndbuf;
+  acpt.get_option(rcvbuf, ec);
+  acpt.get_option(sndbuf, ec);
+  o << "rcvbuf " << rcvbuf.value() << ", sndbuf " << sndbuf.value();
+}
+
+}}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "proxyswiss/config.h"
+
+#include <boost/asio/ip/tcp.hpp>
+
+#include <ostream>
+#include <string>
+
+namespace proxyswiss {
+namespace detail {
+
+// Applies a config::socket_profile. The per-connection calls are best
+// effort, a failed option is not worth dropping the connection for.
+
+// Buffer sizes, which accepted sockets inherit, TCP_DEFER_ACCEPT and
+// TCP_FASTOPEN. Before listen(). Returns false with the names of the
+// options that failed in |failed|.
+bool tune_listener(boost::asio::ip::tcp::acceptor& acpt,
+  const config::socket_profile& prof, std::string& failed);
+
+// Buffer sizes, before connect() so the window scale can match them.
+// TCP_FASTOPEN_CONNECT too if |fastopen|: connect() then returns before
+// the SYN goes out, which waits for the first write, so only for peers
+// that we speak to first.
+void tune_unconnected(boost::asio::ip::tcp::socket& sock,
+  const config::socket_profile& prof, bool fastopen);
+
+// Once connected (or accepted), for the handshake.
+void tune_connected(boost::asio::ip::tcp::socket& sock,
+  const config::socket_profile& prof);
+
+// When the tunnel is up.
+void tune_tunnel(boost::asio::ip::tcp::socket& sock,
+  const config::socket_profile& prof);
+
+// Whether |sock| was connected with TCP_FASTOPEN_CONNECT set.
+bool fastopen_connect_enabled(const boost::asio::ip::tcp::socket& sock);
+
+// Whether the data in the SYN was accepted, by the peer for a connected
+// socket, by us for an accepted one. Only known once the SYN-ACK went by.
+bool syn_data_acked(const boost::asio::ip::tcp::socket& sock);
+
+// The settings, with the ones the platform lacks marked as such.
+void print_socket_profile(const config::socket_profile& prof,
+  std::wostream& o);
+
+// SO_RCVBUF and SO_SNDBUF as the OS has them, which may differ from what
+// was asked for.
+void print_buffer_sizes(const boost::asio::ip::tcp::acceptor& acpt,
+  std::ostream& o);
+
+}}
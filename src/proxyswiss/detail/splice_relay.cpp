@@ -0,0 +1,156 @@
+#include "proxyswiss/detail/splice_relay.h"
+
+#ifdef PROXYSWISS_HAVE_SPLICE
+
+#include <boost/bind/bind.hpp>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define dbgprint(...) __noop
+
+using namespace std;
+using namespace boost::placeholders;
+
+namespace proxyswiss {
+namespace detail {
+
+static const size_t kMaxSpliceSize = 65536; // default pipe capacity
+
+splice_relay::splice_relay(socket& from, socket& to, buffer_pool& pool,
+  padded_counter& bytes, boost::shared_ptr<void> owner)
+  : relay(from, to, pool, bytes, owner), pipe_rd_(-1), pipe_wr_(-1),
+    pipe_bytes_(0), moved_any_(false)
+{
+}
+
+splice_relay::~splice_relay() {
+  if (pipe_rd_ != -1) {
+    ::close(pipe_rd_);
+  }
+  if (pipe_wr_ != -1) {
+    ::close(pipe_wr_);
+  }
+}
+
+void splice_relay::do_start() {
+  int fds[2];
+  if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+    dbgprint("pipe2() failed, errno %d\n", errno);
+    fall_back_to_copy();
+    return;
+  }
+  pipe_rd_ = fds[0];
+  pipe_wr_ = fds[1];
+
+  // splice() is called directly on the descriptors, they must not block.
+  error_code ec;
+  from_.non_blocking(true, ec);
+  if (!ec) {
+    to_.non_blocking(true, ec);
+  }
+  if (ec) {
+    close_all();
+    return;
+  }
+
+  begin_wait_readable();
+}
+
+void splice_relay::fall_back_to_copy() {
+  assert(!moved_any_);
+
+  boost::shared_ptr<relay> r(new copy_relay(from_, to_, pool_, bytes_,
+    owner_));
+  r->set_idle_timer(idle_timer_);
+  r->start();
+}
+
+void splice_relay::begin_wait_readable() {
+  from_.async_wait(socket::wait_read,
+    bind(handler_mem_,
+      boost::bind(&splice_relay::handle_readable, this, _1)));
+}
+
+void splice_relay::handle_readable(error_code err) {
+  if (err) {
+    close_all();
+    return;
+  }
+
+  assert(pipe_bytes_ == 0);
+
+  ssize_t r = ::splice(from_.native_handle(), nullptr, pipe_wr_, nullptr,
+    kMaxSpliceSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+  if (r > 0) {
+    pipe_bytes_ = static_cast<size_t>(r);
+    moved_any_ = true;
+    drain_pipe();
+    return;
+  }
+
+  if (r == 0) {
+    dbgprint("eof\n");
+    shutdown_to();
+    return;
+  }
+
+  switch (errno) {
+  case EAGAIN:
+  case EINTR:
+    begin_wait_readable();
+    return;
+  case EINVAL:
+  case ENOSYS:
+    if (!moved_any_) {
+      fall_back_to_copy();
+      return;
+    }
+    break;
+  }
+
+  dbgprint("hard error, closing\n");
+  close_all();
+}
+
+void splice_relay::drain_pipe() {
+  while (pipe_bytes_) {
+    ssize_t r = ::splice(pipe_rd_, nullptr, to_.native_handle(), nullptr,
+      pipe_bytes_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+    if (r > 0) {
+      pipe_bytes_ -= static_cast<size_t>(r);
+      count_bytes(static_cast<size_t>(r));
+      continue;
+    }
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r < 0 && errno == EAGAIN) {
+      to_.async_wait(socket::wait_write,
+        bind(handler_mem_,
+          boost::bind(&splice_relay::handle_writable, this, _1)));
+      return;
+    }
+
+    close_all();
+    return;
+  }
+
+  begin_wait_readable();
+}
+
+void splice_relay::handle_writable(error_code err) {
+  if (err) {
+    close_all();
+    return;
+  }
+  drain_pipe();
+}
+
+}}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "proxyswiss/detail/relay.h"
+
+#if defined(__linux__)
+#define PROXYSWISS_HAVE_SPLICE
+#endif
+
+#ifdef PROXYSWISS_HAVE_SPLICE
+
+namespace proxyswiss {
+namespace detail {
+
+// Zero-copy relay: socket -> pipe -> socket with splice(2), the data never
+// enters user space. If the kernel refuses to splice these sockets before
+// the first byte is moved, falls back to copy_relay.
+class splice_relay: public relay {
+public:
+  splice_relay(socket& from, socket& to, buffer_pool& pool,
+    padded_counter& bytes, boost::shared_ptr<void> owner);
+  ~splice_relay();
+
+protected:
+  virtual void do_start() override;
+
+private:
+  void fall_back_to_copy();
+  void begin_wait_readable();
+  void handle_readable(error_code);
+  void drain_pipe();
+  void handle_writable(error_code);
+
+private:
+  handler_memory  handler_mem_;
+  int             pipe_rd_;
+  int             pipe_wr_;
+  size_t          pipe_bytes_;  //< in the pipe, not yet spliced to |to_|
+  bool            moved_any_;
+};
+
+}}
+
+#endif
@@ -0,0 +1,213 @@
+#include "proxyswiss/detail/timer_wheel.h"
+
+#include <boost/bind/bind.hpp>
+
+#include <assert.h>
+
+using namespace std;
+using namespace boost::placeholders;
+
+namespace proxyswiss {
+namespace detail {
+
+timer_wheel::timer::timer(callback cb, void* arg)
+  :
+  wheel_(nullptr), slot_(nullptr), prev_(nullptr), next_(nullptr),
+  expires_(0), timeout_(0), last_touch_(0), idle_(false),
+  cb_(cb), arg_(arg)
+{
+}
+
+timer_wheel::timer::~timer() {
+  if (wheel_) {
+    wheel_->cancel(*this);
+  }
+}
+
+// ---
+
+timer_wheel::timer_wheel(io_context& ioc, chrono::milliseconds tick)
+  :
+  tick_(tick), now_(0), count_(0), running_(false), scheduled_(false),
+  tick_timer_(ioc)
+{
+  for (unsigned level = 0; level < kLevels; level++) {
+    for (uint64_t i = 0; i < kSlots; i++) {
+      slots_[level][i] = nullptr;
+    }
+  }
+}
+
+timer_wheel::~timer_wheel() {
+  // Whatever is still armed belongs to objects outliving the wheel.
+  for (unsigned level = 0; level < kLevels; level++) {
+    for (uint64_t i = 0; i < kSlots; i++) {
+      while (slots_[level][i]) {
+        unlink(*slots_[level][i]);
+      }
+    }
+  }
+}
+
+void timer_wheel::start() {
+  start_time_ = chrono::steady_clock::now();
+  now_ = 0;
+  running_ = true;
+  if (count_) {
+    schedule();
+  }
+}
+
+void timer_wheel::stop() {
+  running_ = false;
+  error_code ec;
+  tick_timer_.cancel(ec);
+}
+
+void timer_wheel::arm(timer& t, chrono::milliseconds timeout, bool idle) {
+  if (t.wheel_) {
+    unlink(t);
+  }
+  // Nothing in the wheel, so the clock can jump to the present, where
+  // handle_tick() would have left it.
+  if (!count_ && running_) {
+    const uint64_t present = elapsed_ticks() + 1;
+    if (now_ < present) {
+      now_ = present;
+    }
+  }
+
+  uint64_t ticks = (chrono::duration_cast<chrono::steady_clock::duration>(
+    timeout) + tick_ - chrono::steady_clock::duration(1)) / tick_;
+  if (ticks < 1) {
+    ticks = 1;
+  }
+  if (ticks > kMaxTicks) {
+    ticks = kMaxTicks;
+  }
+
+  t.timeout_ = ticks;
+  t.last_touch_ = now_;
+  t.expires_ = now_ + ticks;
+  t.idle_ = idle;
+  link(t);
+
+  if (running_ && !scheduled_) {
+    schedule();
+  }
+}
+
+void timer_wheel::cancel(timer& t) {
+  if (t.wheel_) {
+    unlink(t);
+  }
+}
+
+void timer_wheel::link(timer& t) {
+  const uint64_t expires = t.expires_ < now_ ? now_ : t.expires_;
+  const uint64_t delta = expires - now_;
+
+  unsigned level = 0;
+  while (level + 1 < kLevels &&
+         delta >= (static_cast<uint64_t>(1) << (kSlotBits * (level + 1))))
+  {
+    level++;
+  }
+  timer** slot =
+    &slots_[level][(expires >> (kSlotBits * level)) & kSlotMask];
+
+  t.wheel_ = this;
+  t.slot_ = slot;
+  t.prev_ = nullptr;
+  t.next_ = *slot;
+  if (*slot) {
+    (*slot)->prev_ = &t;
+  }
+  *slot = &t;
+  count_++;
+}
+
+void timer_wheel::unlink(timer& t) {
+  assert(t.wheel_ == this);
+
+  if (t.prev_) {
+    t.prev_->next_ = t.next_;
+  }
+  else {
+    *t.slot_ = t.next_;
+  }
+  if (t.next_) {
+    t.next_->prev_ = t.prev_;
+  }
+  t.wheel_ = nullptr;
+  t.slot_ = nullptr;
+  t.prev_ = t.next_ = nullptr;
+  count_--;
+}
+
+// Moves the timers of the |level| slot now coming due one level down.
+void timer_wheel::cascade(unsigned level) {
+  timer** slot =
+    &slots_[level][(now_ >> (kSlotBits * level)) & kSlotMask];
+  while (*slot) {
+    timer& t(**slot);
+    unlink(t);
+    link(t);
+  }
+}
+
+void timer_wheel::run_tick() {
+  const uint64_t index = now_ & kSlotMask;
+  for (unsigned level = 1; level < kLevels; level++) {
+    if ((now_ >> (kSlotBits * (level - 1))) & kSlotMask) {
+      break;
+    }
+    cascade(level);
+  }
+  now_++;
+
+  // A callback may arm or cancel anything, including the next timer here,
+  // so take them one at a time.
+  timer** slot = &slots_[0][index];
+  while (*slot) {
+    timer& t(**slot);
+    unlink(t);
+    if (t.idle_ && t.last_touch_ + t.timeout_ >= now_) {
+      // Touched since armed, not idle long enough yet.
+      t.expires_ = t.last_touch_ + t.timeout_;
+      link(t);
+      continue;
+    }
+    t.cb_(t.arg_);
+  }
+}
+
+uint64_t timer_wheel::elapsed_ticks() const {
+  return static_cast<uint64_t>(
+    (chrono::steady_clock::now() - start_time_) / tick_);
+}
+
+void timer_wheel::schedule() {
+  scheduled_ = true;
+  tick_timer_.expires_at(start_time_ +
+    tick_ * static_cast<chrono::steady_clock::rep>(now_));
+  tick_timer_.async_wait(
+    boost::bind(&timer_wheel::handle_tick, this, _1));
+}
+
+void timer_wheel::handle_tick(error_code err) {
+  scheduled_ = false;
+  if (err || !running_) {
+    return;
+  }
+
+  const uint64_t target = elapsed_ticks();
+  while (now_ <= target && count_) {
+    run_tick();
+  }
+  if (count_ && !scheduled_) {
+    schedule();
+  }
+}
+
+}}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace proxyswiss {
+namespace detail {
+
+// Deadlines for the sessions of one worker, in a hierarchical timing
+// wheel: 4 levels of 64 slots, so with the default 100 ms tick a timer
+// can be up to ~19 days away. Arming, re-arming and cancelling are O(1);
+// a timer only moves when a coarser slot it sits in comes due, at most
+// once per level. The wheel ticks on a single steady_timer of the worker's
+// io_context. Not thread safe, like everything else of a worker.
+class timer_wheel {
+public:
+  typedef boost::asio::io_context io_context;
+  typedef boost::system::error_code error_code;
+
+  static const unsigned kDefaultTickMs = 100;
+
+  // Embedded in the object it times out, and disarmed by its destructor.
+  class timer {
+  public:
+    // Called on the io thread when the timer expires, once per arm().
+    typedef void (*callback)(void* arg);
+
+    timer(callback cb, void* arg);
+    ~timer();
+
+    bool armed() const { return wheel_ != nullptr; }
+
+    // For timers armed as idle: starts the countdown over. Just a store,
+    // the timer is moved when it comes due.
+    void touch() {
+      if (wheel_) {
+        last_touch_ = wheel_->now_;
+      }
+    }
+
+  private:
+    friend class timer_wheel;
+
+    timer(const timer&) = delete;
+    timer& operator=(const timer&) = delete;
+
+    timer_wheel*  wheel_;   //< null if not armed
+    timer**       slot_;
+    timer*        prev_;
+    timer*        next_;
+    uint64_t      expires_;
+    uint64_t      timeout_;
+    uint64_t      last_touch_;
+    bool          idle_;
+    callback      cb_;
+    void*         arg_;
+  };
+
+  explicit timer_wheel(io_context& ioc,
+    std::chrono::milliseconds tick =
+      std::chrono::milliseconds(kDefaultTickMs));
+  ~timer_wheel();
+
+  void start();
+  void stop();
+
+  // Re-arming an armed timer moves it. The timeout is rounded up to whole
+  // ticks. An |idle| timer expires only once |timeout| has passed since
+  // the last touch().
+  void arm(timer& t, std::chrono::milliseconds timeout, bool idle = false);
+  void cancel(timer& t);
+
+  size_t size() const { return count_; }
+
+private:
+  static const unsigned kLevels = 4;
+  static const unsigned kSlotBits = 6;
+  static const uint64_t kSlots = 1 << kSlotBits;
+  static const uint64_t kSlotMask = kSlots - 1;
+  static const uint64_t kMaxTicks =
+    (static_cast<uint64_t>(1) << (kSlotBits * kLevels)) - 1;
+
+  void link(timer&);
+  void unlink(timer&);
+  void cascade(unsigned level);
+  void run_tick();
+  uint64_t elapsed_ticks() const;
+  void schedule();
+  void handle_tick(error_code);
+
+  timer_wheel(const timer_wheel&) = delete;
+  timer_wheel& operator=(const timer_wheel&) = delete;
+
+private:
+  std::chrono::steady_clock::duration    tick_;
+  std::chrono::steady_clock::time_point  start_time_;
+  uint64_t                               now_;  //< the next tick to run
+  size_t                                 count_;
+  bool                                   running_;
+  // The tick timer is only waited on while timers are armed, so an idle
+  // worker isn't woken up for nothing.
+  bool                                   scheduled_;
+  timer*                                 slots_[kLevels][kSlots];
+  boost::asio::steady_timer              tick_timer_;
+};
+
+}}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "proxyswiss/detail/session.h"
+#include "proxyswiss/detail/worker_context.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace proxyswiss {
+namespace detail {
+
+// A thread with its own io_context. Sessions accepted by a worker never
+// leave its thread, so the relay path needs no locks.
+struct worker {
+  typedef boost::asio::io_context io_context;
+  typedef boost::asio::ip::tcp::acceptor acceptor;
+  typedef boost::asio::executor_work_guard<io_context::executor_type>
+    work_guard;
+  typedef boost::shared_ptr<detail::session> session_shared_ptr;
+
+  io_context*                      pioc;
+  std::unique_ptr<io_context>      ioc_uptr;   //< null for the caller's ioc
+  std::unique_ptr<work_guard>      work_uptr;
+  std::unique_ptr<acceptor>        acpt_uptr;  //< null if not accepting
+  // One per outstanding accept, cfg.server.pending_accepts of them.
+  std::vector<session_shared_ptr>  pending;
+  std::thread                      thread;
+  std::shared_ptr<worker_context>  ctx;
+
+  worker(io_context& ioc): pioc(&ioc), ctx(new worker_context)
+  {
+  }
+
+  worker(): ioc_uptr(new io_context(1)), ctx(new worker_context)
+  {
+    pioc = ioc_uptr.get();
+  }
+};
+
+}}
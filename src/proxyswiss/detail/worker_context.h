@@ -0,0 +1,45 @@
+#pragma once
+
+#include "proxyswiss/detail/buffer_pool.h"
+#include "proxyswiss/detail/counters.h"
+#include "proxyswiss/detail/hop_pool.h"
+#include "proxyswiss/detail/dns_cache.h"
+#include "proxyswiss/detail/latency_histogram.h"
+#include "proxyswiss/detail/session_id_table.h"
+#include "proxyswiss/detail/session_pool.h"
+#include "proxyswiss/detail/timer_wheel.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <atomic>
+#include <memory>
+
+namespace proxyswiss {
+namespace detail {
+
+// Per-thread state shared by all sessions of a worker. Sessions hold a
+// shared_ptr to it, so it outlives anything queued in the io_context.
+struct worker_context {
+  std::atomic<size_t>          active_sessions;
+  std::atomic<size_t>          accepted_sessions;
+  buffer_pool                  buf_pool;
+  // Shared with the sessions' allocators, see session_allocator.
+  std::shared_ptr<session_pool>  session_pool_sptr;
+  // Null if cfg.output.hop_pool_size is 0 or there is no proxy chain.
+  boost::shared_ptr<hop_pool>  hop_pool_sptr;
+  // The same for all workers.
+  std::shared_ptr<dns_cache>   dns_cache_sptr;
+  std::shared_ptr<session_id_table>  session_ids_sptr;
+  // Sized for cfg.output.proxy_chain, set by the server.
+  std::unique_ptr<latency_stats>  latency_uptr;
+  // Session deadlines, on the worker's io_context. Set by the server.
+  std::unique_ptr<timer_wheel>  wheel_uptr;
+  worker_counters              counters;
+
+  worker_context(): active_sessions(0), accepted_sessions(0),
+    session_pool_sptr(std::make_shared<session_pool>())
+  {
+  }
+};
+
+}}
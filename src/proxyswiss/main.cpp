@@ -39,14 +39,59 @@ static void usage() {
   }
 
   cout << "Usage:\n";
-  cout << " proxyswiss proxy <inProxy> [proxy-chain]\n";
+  cout << " proxyswiss [options] proxy <inProxy> [proxy-chain]\n";
   cout << "OR\n";
-  cout << " proxyswiss tunnel <tunIn> <tunOut> [proxy-chain]\n";
+  cout << " proxyswiss [options] tunnel <tunIn> <tunOut> [proxy-chain]\n";
+  cout << "\n";
+  cout << " options:\n";
+  cout << "  --threads=N        worker threads, each with its own acceptor\n";
+  cout << "  --thread-stats=SEC print session and buffer stats\n";
+  cout << "  --pending-accepts=N accepts kept outstanding per acceptor\n";
+  cout << "                     (default 4)\n";
+  cout << "  --relay=MODE       copy (default), splice (Linux, zero-copy),\n";
+  cout << "                     pipelined (read-ahead while writing) or\n";
+  cout << "                     parked (no buffers held by idle tunnels)\n";
+  cout << "  --max-in-flight=KB pipelined relay backpressure limit, at\n";
+  cout << "                     most 128 (default)\n";
+  cout << "  --admin-port=PORT  serve Prometheus metrics on 127.0.0.1:PORT\n";
+  cout << "  --connect-delay=MS try the next resolved address after MS\n";
+  cout << "                     (default 250)\n";
+  cout << "  --connect-timeout=SEC give up connecting after SEC, 0 = OS\n";
+  cout << "                     default (default 10)\n";
+  cout << "  --handshake-timeout=SEC close clients not done with their\n";
+  cout << "                     request after SEC, 0 = never (default 30)\n";
+  cout << "  --hop-timeout=SEC  fail a chain hop not connected through\n";
+  cout << "                     after SEC, 0 = never (default 30)\n";
+  cout << "  --idle-timeout=SEC close tunnels idle for SEC, 0 = never\n";
+  cout << "                     (default)\n";
+  cout << "  --dns-ttl=SEC      cache resolved names (default 60)\n";
+  cout << "  --dns-negative-ttl=SEC cache resolve failures (default 5)\n";
+  cout << "  --hop-pool=N       keep N authenticated connections to the\n";
+  cout << "                     first proxy of the chain, per thread\n";
+  cout << "  --engine=ENGINE    protocol handshakes as callback (default)\n";
+  cout << "                     or coro (C++20 coroutines, if built)\n";
+  cout << "  --sock-profile=NAME:SETTING[,...] define a socket profile,\n";
+  cout << "                     settings: nodelay[=handshake], rcvbuf=N,\n";
+  cout << "                     sndbuf=N, notsent-lowat=N, quickack,\n";
+  cout << "                     keepalive=IDLE/INTVL/CNT, defer-accept=SEC\n";
+  cout << "                     (listener only), fastopen[=QUEUE] (queue\n";
+  cout << "                     on the listener, default 256)\n";
+  cout << "  --in-sock=NAME     socket profile of the listener and the\n";
+  cout << "                     clients, default, latency, bulk or defined\n";
+  cout << "  --out-sock=NAME    socket profile of outbound connections\n";
   cout << "\n";
   cout << " inProxy     => proxy-server-type://[uname:pwd@]ip:port\n";
   cout << " tunIn       => ip:port\n";
   cout << " tunOut      => host:port\n";
-  cout << " proxy-chain => proxy-client-type://[uname:pwd@]host:port [, ...]\n";
+  cout << " proxy-chain => proxy-client-type://[uname:pwd@]host:port\n";
+  cout << "                [hop-options] [, ...]\n";
+  cout << "\n";
+  cout << " hop-options:\n";
+  cout << "  --optimistic       send the socks5 greeting, credentials and\n";
+  cout << "                     request in one write, not every proxy\n";
+  cout << "                     accepts it\n";
+  cout << "  --sock=NAME        socket profile, first hop only, same as\n";
+  cout << "                     --out-sock\n";
   cout << "\n";
   wcout<<L"  proxy-server-type => " << server_types_str << L"\n";
   wcout<<L"  proxy-client-type => " << client_types_str << L"\n";
@@ -92,6 +137,7 @@ int wmain(int argc, wchar_t* argv[]) {
   proxyswiss::server srv(ioc, cfg);
 
   srv.enable_print_proxy_errors(true);
+  srv.enable_latency_dump(true);
   //srv.enable_logging(L".\\server_connect_log.txt");
 
   boost::system::error_code err;
@@ -102,6 +148,10 @@ int wmain(int argc, wchar_t* argv[]) {
     return -1;
   }
 
+  cout << "Listener: ";
+  srv.print_listener_tuning(cout);
+  cout << "\n";
+
   cout << "Running...\n";
 
   srv.start();
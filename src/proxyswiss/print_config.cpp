@@ -1,5 +1,6 @@
 
 #include "proxyswiss/print_config.h"
+#include "proxyswiss/detail/socket_tuning.h"
 #include "proxy/server_session.h"
 
 #include "common/base/str.h"
@@ -12,6 +13,21 @@ using namespace std;
 #define wstr_to_str common::wstr_to_str
 #define str_to_wstr common::str_to_wstr
 
+static const wchar_t* relay_mode_to_string(proxyswiss::config::relay_mode m)
+{
+  switch (m) {
+  case proxyswiss::config::eRelayCopy: return L"copy";
+  case proxyswiss::config::eRelaySplice: return L"splice";
+  case proxyswiss::config::eRelayPipelined: return L"pipelined";
+  case proxyswiss::config::eRelayParked: return L"parked";
+  default: return L"?";
+  }
+}
+
+static wstring seconds_or_none(unsigned sec) {
+  return sec ? to_wstring(sec) + L" s" : wstring(L"none");
+}
+
 void print_config(const proxyswiss::config& cfg, wstringstream& output) {
 
   wstringstream& o(output);
@@ -35,6 +51,44 @@ void print_config(const proxyswiss::config& cfg, wstringstream& output) {
     assert(0);
     return;
   }
+  o << L" Socket profile: ";
+  proxyswiss::detail::print_socket_profile(cfg.input.sock_profile, o);
+  o << L"\n";
+
+  o << L"Server:\n";
+  o << L" Worker threads: " << cfg.server.num_threads << L"\n";
+  o << L" Pending accepts: " << cfg.server.pending_accepts << L"\n";
+  if (cfg.server.admin_port) {
+    o << L" Metrics: http://127.0.0.1:" << cfg.server.admin_port <<
+      L"/metrics\n";
+  }
+  o << L" Relay: " << relay_mode_to_string(cfg.relay.mode);
+  if (cfg.relay.mode == proxyswiss::config::eRelayPipelined) {
+    o << L", max in flight " << cfg.relay.max_in_flight / 1024 << L" KiB";
+  }
+  o << L"\n";
+  o << L" Connect: next address after " << cfg.output.connect_attempt_delay <<
+    L" ms, timeout ";
+  if (cfg.output.connect_timeout) {
+    o << cfg.output.connect_timeout << L" s\n";
+  }
+  else {
+    o << L"OS default\n";
+  }
+  o << L" Timeouts: handshake " <<
+    seconds_or_none(cfg.input.handshake_timeout) << L", hop " <<
+    seconds_or_none(cfg.output.hop_timeout) << L", idle " <<
+    seconds_or_none(cfg.relay.idle_timeout) << L"\n";
+  o << L" DNS cache TTL: " << cfg.dns.ttl << L" s, failures " <<
+    cfg.dns.negative_ttl << L" s\n";
+  o << L" Handshake engine: " <<
+    (cfg.input.engine == proxy::eCoroutineEngine ? L"coro" : L"callback") <<
+    L"\n";
+
+  o << L"Output:\n";
+  o << L" Socket profile: ";
+  proxyswiss::detail::print_socket_profile(cfg.output.sock_profile, o);
+  o << L"\n";
 
   if (cfg.output.proxy_chain.empty()) {
     o << L"Output proxy chain is empty.\n";
@@ -42,6 +96,10 @@ void print_config(const proxyswiss::config& cfg, wstringstream& output) {
   }
 
   o << L"Output proxy chain:\n";
+  if (cfg.output.hop_pool_size) {
+    o << L" Warm connections to #0: " << cfg.output.hop_pool_size <<
+      L" per thread\n";
+  }
 
   const proxyswiss::config::proxy_client_info* pci;
   for (size_t i=0; i<cfg.output.proxy_chain.size(); i++) {
@@ -50,7 +108,7 @@ void print_config(const proxyswiss::config& cfg, wstringstream& output) {
       o << L" #" << dec << i << L". " <<
         proxy::client_session_type_to_string(pci->proxy_client_type)
           << L"://" <<
-        pci->proxy_address.to_wstring() << L"\n";
+        pci->proxy_address.to_wstring();
     }
     else {
       o << L" #" << dec << i << L". " <<
@@ -58,7 +116,11 @@ void print_config(const proxyswiss::config& cfg, wstringstream& output) {
           L"://" <<
         str_to_wstr(pci->proxy_creds.username) << L":" <<
         str_to_wstr(pci->proxy_creds.password) << L"@" <<
-        pci->proxy_address.to_wstring() << L"\n";
+        pci->proxy_address.to_wstring();
+    }
+    if (pci->optimistic) {
+      o << L" (optimistic)";
     }
+    o << L"\n";
   }
 }
@@ -1,7 +1,15 @@
-
 #include "proxyswiss/server.h"
+#include "proxyswiss/detail/socket_tuning.h"
 
 #include <boost/bind/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <signal.h>
 
 #define dbgprint(...) __noop
 
@@ -12,88 +20,682 @@ using namespace boost::placeholders;
 
 namespace proxyswiss {
 
+#if defined(SO_REUSEPORT)
+typedef boost::asio::detail::socket_option::boolean<
+  SOL_SOCKET, SO_REUSEPORT> reuse_port_option;
+static const bool kHaveReusePort = true;
+#else
+static const bool kHaveReusePort = false;
+#endif
+
+#if defined(SIGUSR1)
+static const int kDumpSignal = SIGUSR1;
+#else
+static const int kDumpSignal = SIGBREAK;
+#endif
+
 server::server(io_context& ioc, const config& cfg)
-  : ioc_(ioc), acpt_(ioc), cfg_(cfg)
+  : ioc_(ioc), cfg_(cfg), next_worker_(0), print_proxy_errors_(false),
+    latency_dump_(false), stats_timer_(ioc), dump_signals_(ioc)
 {
+  const unsigned num_threads =
+    cfg_.server.num_threads ? cfg_.server.num_threads : 1;
+
+  dns_cache_sptr_.reset(new detail::dns_cache(
+    std::chrono::seconds(cfg_.dns.ttl),
+    std::chrono::seconds(cfg_.dns.negative_ttl),
+    cfg_.dns.max_entries));
+  session_ids_sptr_ = std::make_shared<detail::session_id_table>();
+
+  workers_.push_back(worker_uptr(new detail::worker(ioc_)));
+  for (unsigned i = 1; i < num_threads; i++) {
+    workers_.push_back(worker_uptr(new detail::worker()));
+  }
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->ctx->dns_cache_sptr = dns_cache_sptr_;
+    workers_[i]->ctx->session_ids_sptr = session_ids_sptr_;
+    workers_[i]->ctx->latency_uptr.reset(
+      new detail::latency_stats(cfg_.output.proxy_chain.size()));
+    workers_[i]->ctx->counters.set_num_hops(
+      std::max<size_t>(cfg_.output.proxy_chain.size(), 1));
+    workers_[i]->ctx->wheel_uptr.reset(
+      new detail::timer_wheel(*workers_[i]->pioc));
+  }
+
+  if (cfg_.output.hop_pool_size && !cfg_.output.proxy_chain.empty()) {
+    for (size_t i = 0; i < workers_.size(); i++) {
+      workers_[i]->ctx->hop_pool_sptr.reset(new detail::hop_pool(
+        *workers_[i]->pioc, cfg_.output, cfg_.output.hop_pool_size,
+        dns_cache_sptr_));
+    }
+  }
+}
+
+server::~server() {
+  stop();
 }
 
 void server::enable_print_proxy_errors(bool enable) {
   print_proxy_errors_ = enable;
 }
 
+void server::enable_latency_dump(bool enable) {
+  latency_dump_ = enable;
+}
+
 bool server::enable_logging(const wstring& filename) {
-  logfile_.open(filename, std::ios::out);
-  if (!logfile_.is_open()) {
+  std::unique_ptr<detail::connect_log> log(new detail::connect_log());
+  if (!log->open(filename)) {
     return false;
   }
+  connect_log_uptr_ = std::move(log);
   return true;
 }
 
 bool server::open(error_code& err) {
-  acpt_.open(cfg_.input.listen_addr.protocol(), err);
+  // With SO_REUSEPORT every worker has its own acceptor and the kernel
+  // balances connections between them. Otherwise the first worker
+  // accepts and hands sockets to the others round-robin.
+  const bool reuse_port = kHaveReusePort && workers_.size() > 1;
+
+  for (size_t i = 0; i < workers_.size(); i++) {
+    if (i != 0 && !reuse_port) {
+      break;
+    }
+    // The rest share the port the first one got, even if it was 0.
+    const endpoint ep = i == 0 ?
+      cfg_.input.listen_addr : workers_[0]->acpt_uptr->local_endpoint();
+    if (!open_acceptor(*workers_[i], ep, reuse_port, err)) {
+      for (size_t j = 0; j < i; j++) {
+        workers_[j]->acpt_uptr.reset();
+      }
+      return false;
+    }
+  }
+
+  if (cfg_.server.admin_port && !open_admin(err)) {
+    for (size_t i = 0; i < workers_.size(); i++) {
+      workers_[i]->acpt_uptr.reset();
+    }
+    return false;
+  }
+  return true;
+}
+
+bool server::open_admin(error_code& err) {
+  // Loopback only, the metrics are nobody else's business.
+  admin_uptr_.reset(new detail::admin_server(ioc_,
+    boost::bind(&server::make_metrics, this)));
+
+  const endpoint ep(address_v4::loopback(),
+    static_cast<unsigned short>(cfg_.server.admin_port));
+  if (!admin_uptr_->open(ep, err)) {
+    admin_uptr_.reset();
+    return false;
+  }
+  return true;
+}
+
+server::endpoint server::local_endpoint() const {
+  error_code ec;
+  if (workers_.empty() || !workers_[0]->acpt_uptr) {
+    return endpoint();
+  }
+  return workers_[0]->acpt_uptr->local_endpoint(ec);
+}
+
+void server::print_listener_tuning(std::ostream& o) const {
+  if (workers_.empty() || !workers_[0]->acpt_uptr) {
+    return;
+  }
+  detail::print_buffer_sizes(*workers_[0]->acpt_uptr, o);
+  if (!listener_tuning_failed_.empty()) {
+    o << ", failed to set " << listener_tuning_failed_;
+  }
+}
+
+bool server::open_acceptor(detail::worker& w, const endpoint& ep,
+  bool reuse_port, error_code& err)
+{
+  w.acpt_uptr.reset(new detail::worker::acceptor(*w.pioc));
+  detail::worker::acceptor& acpt(*w.acpt_uptr);
+
+  acpt.open(ep.protocol(), err);
   if (err) {
+    dbgprint("acceptor::open(family=%d) failed, error %s.%d (%s)\n",
+      ep.protocol().family(),
+      err.category().name(), err.value(), err.message().c_str());
+
+    w.acpt_uptr.reset();
     return false;
   }
+#if defined(SO_REUSEPORT)
+  if (reuse_port) {
+    acpt.set_option(reuse_port_option(true), err);
+    if (err) {
+      dbgprint("can't set SO_REUSEPORT, error %s.%d (%s)\n",
+        err.category().name(), err.value(), err.message().c_str());
+
+      w.acpt_uptr.reset();
+      return false;
+    }
+  }
+#endif
+  // Not fatal, the listener works with the OS defaults.
+  string failed;
+  if (!detail::tune_listener(acpt, cfg_.input.sock_profile, failed)) {
+    listener_tuning_failed_ = failed;
+  }
+  acpt.bind(ep, err);
   if (!err) {
-    acpt_.bind(cfg_.input.listen_addr, err);
+    static const int backlog = boost::asio::socket_base::max_connections;
+    acpt.listen(backlog, err);
     if (!err) {
-      static const int backlog = boost::asio::socket_base::max_connections;
-      acpt_.listen(backlog, err);
-      if (!err) {
-        return true;
-      }
-      else {
-        dbgprint("acceptor::listen(%d) failed, error %s.%d (%s)\n",
-          backlog, err.category().name(), err.value(),
-          err.message().c_str());
-      }
+      return true;
     }
     else {
-      /*dbgprint("acceptor::bind(%s:%d) failed, error %s.%d (%s)\n",
-        cfg_.input.listen_addr.address().to_string().c_str(),
-        cfg_.input.listen_addr.port(),
-        err.category().name(), err.value(), err.message().c_str());*/
+      dbgprint("acceptor::listen(%d) failed, error %s.%d (%s)\n",
+        backlog, err.category().name(), err.value(),
+        err.message().c_str());
     }
   }
   else {
-    dbgprint("acceptor::open(family=%d) failed, error %s.%d (%s)\n",
-      cfg_.input.listen_addr.protocol().family(),
-      err.category().name(), err.value(), err.message().c_str());
+    /*dbgprint("acceptor::bind(%s:%d) failed, error %s.%d (%s)\n",
+      ep.address().to_string().c_str(),
+      ep.port(),
+      err.category().name(), err.value(), err.message().c_str());*/
   }
-  acpt_.close();
+  w.acpt_uptr.reset();
   return false;
 }
 
 void server::start() {
-  do_accept();
+  for (size_t i = 0; i < workers_.size(); i++) {
+    if (workers_[i]->acpt_uptr) {
+      workers_[i]->pending.resize(cfg_.server.pending_accepts);
+      for (size_t slot = 0; slot < workers_[i]->pending.size(); slot++) {
+        do_accept(i, slot);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < workers_.size(); i++) {
+    detail::worker& w(*workers_[i]);
+    boost::asio::post(*w.pioc,
+      boost::bind(&detail::timer_wheel::start, w.ctx->wheel_uptr.get()));
+    if (w.ctx->hop_pool_sptr) {
+      boost::asio::post(*w.pioc,
+        boost::bind(&detail::hop_pool::start, w.ctx->hop_pool_sptr));
+    }
+  }
+
+  // Worker #0 is run by the caller.
+  for (size_t i = 1; i < workers_.size(); i++) {
+    detail::worker& w(*workers_[i]);
+
+    w.work_uptr.reset(
+      new detail::worker::work_guard(w.pioc->get_executor()));
+
+    io_context* pioc = w.pioc;
+    w.thread = std::thread([pioc]() { pioc->run(); });
+  }
+
+  if (cfg_.server.thread_stats_interval) {
+    begin_print_thread_stats();
+  }
+
+  if (admin_uptr_) {
+    admin_uptr_->start();
+  }
+
+  if (latency_dump_) {
+    error_code ec;
+    dump_signals_.add(kDumpSignal, ec);
+    if (!ec) {
+      begin_wait_dump_signal();
+    }
+  }
 }
 
-void server::do_accept() {
-  sess_sptr_.reset(new detail::session(ioc_, cfg_
-#ifdef _DEBUG
-    , dbg_uid_table_
-#endif
-  ));
+void server::stop() {
+  error_code ec;
+  stats_timer_.cancel(ec);
+  dump_signals_.cancel(ec);
+  if (admin_uptr_) {
+    admin_uptr_->stop();
+  }
+
+  for (size_t i = 1; i < workers_.size(); i++) {
+    detail::worker& w(*workers_[i]);
+    w.work_uptr.reset();
+    w.pioc->stop();
+    if (w.thread.joinable()) {
+      w.thread.join();
+    }
+  }
+
+  // The worker threads are gone, safe to touch their objects. Their
+  // acceptors have accepts pending, closing them any earlier would race
+  // with the worker.
+  for (size_t i = 0; i < workers_.size(); i++) {
+    if (workers_[i]->acpt_uptr) {
+      workers_[i]->acpt_uptr->close(ec);
+    }
+    workers_[i]->ctx->wheel_uptr->stop();
+    if (workers_[i]->ctx->hop_pool_sptr) {
+      workers_[i]->ctx->hop_pool_sptr->stop();
+    }
+  }
+}
+
+void server::get_thread_stats(vector<thread_stats>& stats) const {
+  stats.resize(workers_.size());
+  for (size_t i = 0; i < workers_.size(); i++) {
+    stats[i].active_sessions = workers_[i]->ctx->active_sessions.load();
+    stats[i].accepted_sessions =
+      workers_[i]->ctx->accepted_sessions.load();
+  }
+}
 
-  sess_sptr_->enable_print_proxy_errors(print_proxy_errors_);
+void server::get_hop_pool_stats(detail::hop_pool::stats& stats) const {
+  stats = detail::hop_pool::stats();
+  for (size_t i = 0; i < workers_.size(); i++) {
+    if (workers_[i]->ctx->hop_pool_sptr) {
+      detail::hop_pool::stats worker_stats;
+      workers_[i]->ctx->hop_pool_sptr->get_stats(worker_stats);
+      stats.hits += worker_stats.hits;
+      stats.misses += worker_stats.misses;
+      stats.failed += worker_stats.failed;
+    }
+  }
+}
+
+void server::get_dns_cache_stats(detail::dns_cache::stats& stats) const {
+  dns_cache_sptr_->get_stats(stats);
+}
+
+void server::get_latency_stats(detail::latency_stats::snapshot& stats) const
+{
+  stats = detail::latency_stats::snapshot();
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->ctx->latency_uptr->add_to(stats);
+  }
+}
 
-  acpt_.async_accept(
-    sess_sptr_->sock(),
-    boost::bind(&server::handle_accept, this, _1));
+void server::get_connect_log_stats(detail::connect_log::stats& stats) const
+{
+  stats = detail::connect_log::stats();
+  if (connect_log_uptr_) {
+    connect_log_uptr_->get_stats(stats);
+  }
 }
 
-void server::handle_accept(error_code err) {
+void server::get_buffer_pool_stats(detail::buffer_pool::stats& stats) const
+{
+  stats = detail::buffer_pool::stats();
+  for (size_t i = 0; i < workers_.size(); i++) {
+    detail::buffer_pool::stats worker_stats;
+    workers_[i]->ctx->buf_pool.get_stats(worker_stats);
+    stats += worker_stats;
+  }
+}
+
+void server::get_session_pool_stats(detail::session_pool::stats& stats)
+  const
+{
+  stats = detail::session_pool::stats();
+  for (size_t i = 0; i < workers_.size(); i++) {
+    detail::session_pool::stats worker_stats;
+    workers_[i]->ctx->session_pool_sptr->get_stats(worker_stats);
+    stats += worker_stats;
+  }
+}
+
+size_t server::next_target(size_t acpt_index) {
+  if (workers_[acpt_index]->acpt_uptr && kHaveReusePort &&
+      workers_.size() > 1)
+  {
+    return acpt_index;
+  }
+  size_t target = next_worker_;
+  next_worker_ = (next_worker_ + 1) % workers_.size();
+  return target;
+}
+
+// Every acceptor keeps cfg.server.pending_accepts accepts outstanding,
+// one per slot, each with the session it is going to accept into.
+void server::do_accept(size_t acpt_index, size_t slot) {
+  detail::worker& acpt_worker(*workers_[acpt_index]);
+
+  // The session (and so its sockets) is created on the io_context of the
+  // worker which is going to run it, with memory from that worker's pool.
+  const size_t target = next_target(acpt_index);
+  detail::worker& w(*workers_[target]);
+
+  detail::worker::session_shared_ptr& sess_sptr(acpt_worker.pending[slot]);
+  sess_sptr = boost::allocate_shared<detail::session>(
+    detail::session_allocator<detail::session>(w.ctx->session_pool_sptr),
+    *w.pioc, cfg_, w.ctx);
+
+  sess_sptr->enable_print_proxy_errors(print_proxy_errors_);
+
+  acpt_worker.acpt_uptr->async_accept(
+    sess_sptr->sock(),
+    boost::bind(&server::handle_accept, this, acpt_index, slot, target,
+      _1));
+}
+
+void server::handle_accept(size_t acpt_index, size_t slot, size_t target,
+  error_code err)
+{
+  detail::worker& acpt_worker(*workers_[acpt_index]);
+
   if (err) {
     dbgprint("error %s.%d (%s)\n", err.category().name(), err.value(),
       err.message().c_str());
+
+    if (err == boost::asio::error::operation_aborted) {
+      acpt_worker.pending[slot].reset();
+      return;
+    }
   }
   else {
     dbgprint("accepted\n");
 
-    sess_sptr_->set_log_file(logfile_, history_);
-    sess_sptr_->start();
+    detail::worker& w(*workers_[target]);
+    w.ctx->accepted_sessions++;
+
+    detail::worker::session_shared_ptr sess_sptr;
+    sess_sptr.swap(acpt_worker.pending[slot]);
+
+    if (connect_log_uptr_) {
+      sess_sptr->set_connect_log(*connect_log_uptr_);
+    }
+    sess_sptr->set_active();
+
+    if (target == acpt_index) {
+      sess_sptr->start();
+    }
+    else {
+      boost::asio::post(*w.pioc,
+        boost::bind(&detail::session::start, sess_sptr));
+    }
+  }
+  do_accept(acpt_index, slot);
+}
+
+void server::begin_print_thread_stats() {
+  stats_timer_.expires_after(
+    std::chrono::seconds(cfg_.server.thread_stats_interval));
+
+  stats_timer_.async_wait(
+    boost::bind(&server::handle_print_thread_stats, this, _1));
+}
+
+void server::handle_print_thread_stats(error_code err) {
+  if (err) {
+    return;
+  }
+
+  vector<thread_stats> stats;
+  get_thread_stats(stats);
+
+  cout << "[THREADS]";
+  for (size_t i = 0; i < stats.size(); i++) {
+    cout << " #" << i << ": " << stats[i].active_sessions << " active/" <<
+      stats[i].accepted_sessions << " accepted";
+  }
+  cout << "\n";
+
+  detail::buffer_pool::stats pool_stats;
+  get_buffer_pool_stats(pool_stats);
+
+  cout << "[BUFFERS] hit rate " << static_cast<unsigned>(
+    pool_stats.hit_rate()) << "%, " <<
+    pool_stats.bytes_in_use / 1024 << " KiB in use, " <<
+    pool_stats.bytes_cached / 1024 << " KiB cached\n";
+
+  detail::session_pool::stats sess_pool_stats;
+  get_session_pool_stats(sess_pool_stats);
+
+  cout << "[SESSIONS] " << sess_pool_stats.hits << " recycled, " <<
+    sess_pool_stats.misses << " allocated, " <<
+    sess_pool_stats.cached << " cached\n";
+
+  detail::dns_cache::stats dns_stats;
+  get_dns_cache_stats(dns_stats);
+
+  cout << "[DNS] " << dns_stats.hits << " hits, " <<
+    dns_stats.negative_hits << " negative hits, " << dns_stats.misses <<
+    " misses, " << dns_stats.coalesced << " coalesced, " <<
+    dns_stats.entries << " entries\n";
+
+  if (cfg_.output.hop_pool_size && !cfg_.output.proxy_chain.empty()) {
+    detail::hop_pool::stats hop_stats;
+    get_hop_pool_stats(hop_stats);
+
+    cout << "[HOP POOL] " << hop_stats.hits << " hits, " <<
+      hop_stats.misses << " misses, " << hop_stats.failed <<
+      " failed refills\n";
+  }
+
+  if (connect_log_uptr_) {
+    detail::connect_log::stats log_stats;
+    get_connect_log_stats(log_stats);
+
+    cout << "[CONNECT LOG] " << log_stats.logged << " logged, " <<
+      log_stats.duplicates << " duplicates, " << log_stats.dropped <<
+      " dropped, " << log_stats.untracked << " untracked\n";
+  }
+
+  begin_print_thread_stats();
+}
+
+void server::begin_wait_dump_signal() {
+  dump_signals_.async_wait(
+    boost::bind(&server::handle_dump_signal, this, _1, _2));
+}
+
+void server::handle_dump_signal(error_code err, int) {
+  if (err) {
+    return;
+  }
+
+  print_latency_stats(cout);
+
+  begin_wait_dump_signal();
+}
+
+static void print_histogram(ostream& o, const string& name,
+  const detail::latency_histogram::snapshot& h)
+{
+  o << "[LATENCY] " << left << setw(24) << name << right;
+  o << " n=" << h.count;
+  if (h.count) {
+    o << fixed << setprecision(2) <<
+      " mean=" << h.mean() / 1000.0 <<
+      " p50=" << h.percentile(50) / 1000.0 <<
+      " p90=" << h.percentile(90) / 1000.0 <<
+      " p99=" << h.percentile(99) / 1000.0 <<
+      " p99.9=" << h.percentile(99.9) / 1000.0 <<
+      " max=" << h.max / 1000.0 << " ms";
+    o.unsetf(ios::floatfield);
+  }
+  o << "\n";
+}
+
+void server::print_latency_stats(ostream& o) const {
+  detail::latency_stats::snapshot stats;
+  get_latency_stats(stats);
+
+  const size_t chain_size = cfg_.output.proxy_chain.size();
+
+  print_histogram(o, "handshake read", stats.handshake_read);
+  for (size_t i = 0; i < stats.hop_connect.size(); i++) {
+    string name;
+    if (i == 0) {
+      name = chain_size ? "connect chain[0]" : "connect destination";
+    }
+    else if (i < chain_size) {
+      name = "chain[" + to_string(i-1) + "] -> chain[" + to_string(i) + "]";
+    }
+    else {
+      name = "chain[" + to_string(i-1) + "] -> destination";
+    }
+    print_histogram(o, name, stats.hop_connect[i]);
+  }
+  print_histogram(o, "response write", stats.response_write);
+  print_histogram(o, "tunnel lifetime", stats.tunnel_lifetime);
+  o.flush();
+}
+
+string server::make_metrics() const {
+  ostringstream o;
+  write_metrics(o);
+  return o.str();
+}
+
+static void write_metric_header(ostream& o, const char* name,
+  const char* type, const char* help)
+{
+  o << "# HELP " << name << " " << help << "\n";
+  o << "# TYPE " << name << " " << type << "\n";
+}
+
+void server::write_metrics(ostream& o) const {
+  vector<thread_stats> tstats;
+  get_thread_stats(tstats);
+
+  write_metric_header(o, "proxyswiss_active_sessions", "gauge",
+    "Sessions currently open.");
+  for (size_t i = 0; i < tstats.size(); i++) {
+    o << "proxyswiss_active_sessions{thread=\"" << i << "\"} " <<
+      tstats[i].active_sessions << "\n";
+  }
+  write_metric_header(o, "proxyswiss_accepted_sessions_total", "counter",
+    "Client connections accepted.");
+  for (size_t i = 0; i < tstats.size(); i++) {
+    o << "proxyswiss_accepted_sessions_total{thread=\"" << i << "\"} " <<
+      tstats[i].accepted_sessions << "\n";
+  }
+
+  // Summed over the workers.
+  const size_t num_hops = workers_[0]->ctx->counters.num_hops;
+  vector<uint64_t> succeeded(num_hops), failed(num_hops);
+  uint64_t bytes_upstream = 0, bytes_downstream = 0;
+  uint64_t handshake_timeouts = 0, hop_timeouts = 0, idle_timeouts = 0;
+  uint64_t fastopen_out_tried = 0, fastopen_out_acked = 0;
+  uint64_t fastopen_in_acked = 0;
+  for (size_t i = 0; i < workers_.size(); i++) {
+    const detail::worker_counters& c(workers_[i]->ctx->counters);
+    for (size_t j = 0; j < num_hops; j++) {
+      succeeded[j] += c.hops[j].succeeded.get();
+      failed[j] += c.hops[j].failed.get();
+    }
+    bytes_upstream += c.bytes_upstream.get();
+    bytes_downstream += c.bytes_downstream.get();
+    handshake_timeouts += c.handshake_timeouts.get();
+    hop_timeouts += c.hop_timeouts.get();
+    idle_timeouts += c.idle_timeouts.get();
+    fastopen_out_tried += c.fastopen_out_tried.get();
+    fastopen_out_acked += c.fastopen_out_acked.get();
+    fastopen_in_acked += c.fastopen_in_acked.get();
+  }
+
+  write_metric_header(o, "proxyswiss_connects_total", "counter",
+    "Connects passing or failing at each chain index.");
+  for (size_t j = 0; j < num_hops; j++) {
+    const string index = cfg_.output.proxy_chain.empty() ?
+      string("direct") : to_string(j);
+    o << "proxyswiss_connects_total{chain_index=\"" << index <<
+      "\",result=\"succeeded\"} " << succeeded[j] << "\n";
+    o << "proxyswiss_connects_total{chain_index=\"" << index <<
+      "\",result=\"failed\"} " << failed[j] << "\n";
+  }
+
+  write_metric_header(o, "proxyswiss_relayed_bytes_total", "counter",
+    "Bytes relayed through tunnels.");
+  o << "proxyswiss_relayed_bytes_total{direction=\"upstream\"} " <<
+    bytes_upstream << "\n";
+  o << "proxyswiss_relayed_bytes_total{direction=\"downstream\"} " <<
+    bytes_downstream << "\n";
+
+  write_metric_header(o, "proxyswiss_timeouts_total", "counter",
+    "Sessions closed by a deadline, by stage.");
+  o << "proxyswiss_timeouts_total{stage=\"handshake\"} " <<
+    handshake_timeouts << "\n";
+  o << "proxyswiss_timeouts_total{stage=\"hop\"} " << hop_timeouts << "\n";
+  o << "proxyswiss_timeouts_total{stage=\"idle\"} " << idle_timeouts << "\n";
+
+  write_metric_header(o, "proxyswiss_fastopen_total", "counter",
+    "TCP Fast Open connects to the first hop, and SYN data accepted "
+    "by the hop (out) or from clients (in).");
+  o << "proxyswiss_fastopen_total{direction=\"out\",result=\"tried\"} " <<
+    fastopen_out_tried << "\n";
+  o << "proxyswiss_fastopen_total{direction=\"out\",result=\"accepted\"} " <<
+    fastopen_out_acked << "\n";
+  o << "proxyswiss_fastopen_total{direction=\"in\",result=\"accepted\"} " <<
+    fastopen_in_acked << "\n";
+
+  detail::buffer_pool::stats pool_stats;
+  get_buffer_pool_stats(pool_stats);
+
+  write_metric_header(o, "proxyswiss_buffer_pool_acquires_total", "counter",
+    "Relay buffers taken from the pool (hit) or allocated (miss).");
+  o << "proxyswiss_buffer_pool_acquires_total{result=\"hit\"} " <<
+    pool_stats.hits << "\n";
+  o << "proxyswiss_buffer_pool_acquires_total{result=\"miss\"} " <<
+    pool_stats.misses << "\n";
+  write_metric_header(o, "proxyswiss_buffer_pool_bytes", "gauge",
+    "Relay buffer memory.");
+  o << "proxyswiss_buffer_pool_bytes{state=\"in_use\"} " <<
+    pool_stats.bytes_in_use << "\n";
+  o << "proxyswiss_buffer_pool_bytes{state=\"cached\"} " <<
+    pool_stats.bytes_cached << "\n";
+
+  detail::session_pool::stats sess_pool_stats;
+  get_session_pool_stats(sess_pool_stats);
+
+  write_metric_header(o, "proxyswiss_session_pool_allocs_total", "counter",
+    "Sessions created in recycled (hit) or new (miss) memory.");
+  o << "proxyswiss_session_pool_allocs_total{result=\"hit\"} " <<
+    sess_pool_stats.hits << "\n";
+  o << "proxyswiss_session_pool_allocs_total{result=\"miss\"} " <<
+    sess_pool_stats.misses << "\n";
+  write_metric_header(o, "proxyswiss_session_pool_cached", "gauge",
+    "Recycled session blocks waiting for reuse.");
+  o << "proxyswiss_session_pool_cached " << sess_pool_stats.cached << "\n";
+
+  detail::dns_cache::stats dns_stats;
+  get_dns_cache_stats(dns_stats);
+
+  write_metric_header(o, "proxyswiss_dns_lookups_total", "counter",
+    "Host name lookups by outcome.");
+  o << "proxyswiss_dns_lookups_total{result=\"hit\"} " <<
+    dns_stats.hits << "\n";
+  o << "proxyswiss_dns_lookups_total{result=\"negative_hit\"} " <<
+    dns_stats.negative_hits << "\n";
+  o << "proxyswiss_dns_lookups_total{result=\"miss\"} " <<
+    dns_stats.misses << "\n";
+  o << "proxyswiss_dns_lookups_total{result=\"coalesced\"} " <<
+    dns_stats.coalesced << "\n";
+  write_metric_header(o, "proxyswiss_dns_cache_entries", "gauge",
+    "Names in the DNS cache.");
+  o << "proxyswiss_dns_cache_entries " << dns_stats.entries << "\n";
+
+  if (connect_log_uptr_) {
+    detail::connect_log::stats log_stats;
+    get_connect_log_stats(log_stats);
+
+    write_metric_header(o, "proxyswiss_connect_log_entries_total",
+      "counter", "Successful connects seen by the connect log.");
+    o << "proxyswiss_connect_log_entries_total{result=\"logged\"} " <<
+      log_stats.logged << "\n";
+    o << "proxyswiss_connect_log_entries_total{result=\"duplicate\"} " <<
+      log_stats.duplicates << "\n";
+    o << "proxyswiss_connect_log_entries_total{result=\"dropped\"} " <<
+      log_stats.dropped << "\n";
   }
-  do_accept();
 }
 
 }
@@ -1,19 +1,19 @@
-
 #pragma once
 
 #include "proxyswiss/config.h" 
 
+#include "proxyswiss/detail/admin_server.h"
+#include "proxyswiss/detail/connect_log.h"
 #include "proxyswiss/detail/session.h"
-
-#ifdef _DEBUG
-#include "proxyswiss/detail/debug_uid_table.h"
-#endif
+#include "proxyswiss/detail/worker.h"
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/shared_ptr.hpp>
-#include <fstream>
-#include <set>
+#include <memory>
+#include <vector>
 
 namespace proxyswiss {
 
@@ -23,34 +23,84 @@ public:
   typedef boost::asio::ip::tcp::endpoint endpoint;
   typedef boost::system::error_code error_code;
 
+  struct thread_stats {
+    size_t active_sessions;
+    size_t accepted_sessions;
+  };
+
+  // |ioc| is used by the first worker. If cfg.server.num_threads > 1, the
+  // rest of the workers get their own io_contexts and threads, started
+  // by start().
   server(io_context& ioc, const config& cfg);
+  ~server();
 
   void enable_print_proxy_errors(bool enable);
+  // Prints the latency histograms on SIGUSR1 (SIGBREAK, Ctrl+Break, on
+  // Windows). Takes effect in start().
+  void enable_latency_dump(bool enable);
+  // Destinations connected to are written to |filename|, each once.
   bool enable_logging(const std::wstring& filename);
 
   bool open(error_code& err);
   void start();
+  // From the thread running |ioc|, or once it is not running any more.
+  // Joins the other workers' threads before touching their objects.
+  void stop();
 
-private:
-  void do_accept();
-  void handle_accept(error_code);
+  // The address the server listens on, after open(). Tells the port
+  // picked by the system if cfg.input.listen_addr had port 0.
+  endpoint local_endpoint() const;
+  // The listener's buffer sizes as the OS set them, after open(), and the
+  // options of cfg.input.sock_profile it refused.
+  void print_listener_tuning(std::ostream& o) const;
+
+  // One entry per worker thread, [0] is the caller's io_context.
+  void get_thread_stats(std::vector<thread_stats>& stats) const;
+
+  // Summed over all workers.
+  void get_buffer_pool_stats(detail::buffer_pool::stats& stats) const;
+  void get_session_pool_stats(detail::session_pool::stats& stats) const;
+  void get_hop_pool_stats(detail::hop_pool::stats& stats) const;
+  void get_dns_cache_stats(detail::dns_cache::stats& stats) const;
+  void get_latency_stats(detail::latency_stats::snapshot& stats) const;
+  // Zeros if logging is not enabled.
+  void get_connect_log_stats(detail::connect_log::stats& stats) const;
+
+  void print_latency_stats(std::ostream& o) const;
+  // Prometheus text format.
+  void write_metrics(std::ostream& o) const;
 
 private:
-#ifdef _DEBUG
-  detail::debug_uid_table dbg_uid_table_;
-#endif
+  bool open_acceptor(detail::worker&, const endpoint&, bool reuse_port,
+    error_code&);
+  bool open_admin(error_code&);
+  std::string make_metrics() const;
+  void do_accept(size_t, size_t);
+  void handle_accept(size_t, size_t, size_t, error_code);
+  size_t next_target(size_t);
+
+  void begin_print_thread_stats();
+  void handle_print_thread_stats(error_code);
+  void begin_wait_dump_signal();
+  void handle_dump_signal(error_code, int);
 
 private:
-  typedef boost::asio::ip::tcp::acceptor acceptor;
-  typedef boost::shared_ptr<detail::session> session_shared_ptr;
+  typedef std::unique_ptr<detail::worker> worker_uptr;
 
   io_context& ioc_;
-  acceptor                acpt_;
-  const config&           cfg_;
-  session_shared_ptr      sess_sptr_;
-  bool                    print_proxy_errors_;
-  std::ofstream           logfile_;
-  std::set<std::string>   history_;
+  const config&             cfg_;
+  // Before workers_, the sessions point to it.
+  std::unique_ptr<detail::connect_log>  connect_log_uptr_;
+  std::vector<worker_uptr>  workers_;
+  std::shared_ptr<detail::dns_cache>  dns_cache_sptr_;
+  std::shared_ptr<detail::session_id_table>  session_ids_sptr_;
+  std::unique_ptr<detail::admin_server>  admin_uptr_;
+  std::string               listener_tuning_failed_;
+  size_t                    next_worker_;
+  bool                      print_proxy_errors_;
+  bool                      latency_dump_;
+  boost::asio::steady_timer stats_timer_;
+  boost::asio::signal_set   dump_signals_;
 };
 
 }